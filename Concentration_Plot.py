@@ -1,11 +1,23 @@
 # Import necessary libraries
+import os
 import pandas as pd
 import matplotlib.pyplot as plt
 import numpy as np
+from Trajectory import read_trajectory
 
-# Read the data from output.txt
-data_8 = pd.read_csv("Real_Test_MC.txt", delimiter='\t')
-data_9 = pd.read_csv("Real_Test_RK.txt", delimiter='\t')
+# Time window shown in the trajectory plots.
+t_window = (10e-16, 10e-11)
+
+def load_run(name):
+    # Prefer the binary trajectory if the engine wrote one; only the
+    # blocks inside the plotted window are decoded.
+    if os.path.exists(name + ".ptraj"):
+        return read_trajectory(name + ".ptraj", *t_window)
+    return read_trajectory(name + ".txt", *t_window)
+
+# Read the data from the engine outputs
+data_8 = load_run("Real_Test_MC")
+data_9 = load_run("Real_Test_RK")
 data_10 = pd.read_csv("recomb_prob.txt", delimiter='\t')
 
 time          = data_10.iloc[:, 0]
@@ -84,7 +96,7 @@ plt.ylabel('Concentration', fontsize=18)
 plt.xscale('log')
 plt.xticks(fontsize=16)
 plt.yticks(fontsize=16)
-plt.xlim(10e-16, 10e-11)
+plt.xlim(*t_window)
 #plt.title('Concentration vs Time')
 plt.legend(fontsize=14)
 plt.grid(True)
@@ -114,7 +126,7 @@ plt.ylabel('Reaction Rate', fontsize=18)
 plt.xticks(fontsize=16)
 plt.yticks(fontsize=16)
 plt.xscale('log')
-plt.xlim(10e-16, 10e-11)
+plt.xlim(*t_window)
 #plt.title('Concentration vs Time')
 plt.legend(fontsize=14)
 plt.grid(True)
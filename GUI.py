@@ -8,11 +8,14 @@
 # Import of Libraries
 import tkinter as tk
 from tkinter import messagebox
+from tkinter import ttk
 import subprocess
 import os
 import matplotlib.pyplot as plt
 import pandas as pd
 import numpy as np
+from Trajectory import read_trajectory
+from SimulationServer import SimulationServer, SimulationError
 
 #Choice of colors for plots
 colors_colourblind = np.array(["blue", "black", "orange", "cyan", "palevioletred", "lime", "darkmagenta"])
@@ -29,13 +32,18 @@ def compile_cpp_code(cpp_file):
     This function serves to compile the C++ code to run the simulation of
     Plasma-Surface Recombination. It assumes the user has the header files
     in a folder named inc2 and the .cpp files are in a folder named src2 .
+    The shared trajectory writer lives in common/inc and common/src.
+    The executable is only rebuilt when a source is newer than it.
 
     This function takes a .cpp file and outputs a executable.
     """
 
     try:
 
-        compile_command = f"g++ -I inc2 src2/*.cpp -o exec"
+        if not sources_changed("exec"):
+            return "./exec"
+
+        compile_command = f"g++ -std=c++17 -O2 -pthread -I inc2 -I common/inc src2/*.cpp common/src/*.cpp -o exec"
         result = subprocess.run(
             compile_command, shell=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE
         )
@@ -52,34 +60,94 @@ def compile_cpp_code(cpp_file):
         messagebox.showerror("Error", f"Error compiling code: {str(e)}")
         return None
 
-def run_cpp_code(react_program, selected_reactions, parameters):
+def sources_changed(program):
+
+    """
+    This function checks whether the executable is missing or older than
+    any of the C++ sources and headers it is built from.
+    """
+
+    if not os.path.exists(program):
+        return True
+    built = os.path.getmtime(program)
+    for folder in ["src2", "inc2", "common/src", "common/inc"]:
+        for name in os.listdir(folder):
+            if os.path.getmtime(os.path.join(folder, name)) > built:
+                return True
+    return False
+
+# Simulation server shared by the runs of the session, with the modification
+# time of the executable it was started from.
+simulation_server = None
+simulation_server_built = None
+
+def get_server(program):
+
+    """
+    This function serves to start the simulation server, or to reuse the
+    one already running when the executable has not been rebuilt since.
+
+    This function takes a executable and outputs a SimulationServer.
+    """
+
+    global simulation_server, simulation_server_built
+
+    built = os.path.getmtime(program)
+    if simulation_server is not None and (not simulation_server.alive() or simulation_server_built != built):
+        simulation_server.close()
+        simulation_server = None
+    if simulation_server is None:
+        simulation_server = SimulationServer(program)
+        simulation_server_built = built
+    return simulation_server
+
+def run_cpp_code(react_program, selected_reactions, parameters, binary_output=False, mean_field=False):
 
     """
     This function serves to run the C++ code compiled in the previous function.
 
     This function takes a executable, a string of the selected reactions
-    and of the parameters and outputs None. 
+    and of the parameters and outputs None. The run is sent to the
+    simulation server, which streams the trajectory back for the plots and
+    also writes it to output.txt, or with binary_output to the indexed binary
+    trajectory output.ptraj. With mean_field the deterministic rate equations
+    of the selected reactions are solved instead of running the Monte Carlo
+    simulation. Progress is shown in a progress window as the server reports it.
     """
 
     try:
 
-        command = [react_program] + selected_reactions + parameters
+        output_file = "output.ptraj" if binary_output else "output.txt"
+        arguments = selected_reactions + parameters + ["--output=" + output_file]
+        if mean_field:
+            arguments.append("--engine=ode")
 
-        process = subprocess.Popen(command, stderr=subprocess.PIPE, text=True, bufsize=1)
+        # Progress window, updated as the engine reports (at most a few times per second).
+        progress_win = tk.Toplevel()
+        progress_win.title("Simulation progress")
+        progress_bar = ttk.Progressbar(progress_win, length=300, maximum=1.0)
+        progress_bar.pack(padx=10, pady=5)
+        progress_label = tk.Label(progress_win, text="Starting...")
+        progress_label.pack(padx=10, pady=5)
+        progress_win.update()
 
-        process.wait()
-        error_text = process.stderr.read()
+        def on_progress(fraction, events, rate, eta):
+            progress_bar["value"] = fraction
+            eta_text = f", ETA {eta:.0f} s" if eta >= 0 else ""
+            progress_label.config(text=f"{fraction:.0%} - {events} events, {rate:.3g} events/s{eta_text}")
+            progress_win.update()
 
-        if process.returncode != 0:
-            messagebox.showerror("Error", f"Error running code:\n{error_text}")
+        try:
+            data = get_server(react_program).run(arguments, on_progress)
+        finally:
+            progress_win.destroy()
 
-        else:
-            messagebox.showinfo("Success", "Code executed successfully. Check .txt files for the output")
-            output_file = "output.txt"
-            if os.path.exists(output_file):
-                generate_plots(output_file)
-            else:
-                print("Output file not found; plot generation skipped.")
+        messagebox.showinfo("Success", f"Code executed successfully. The trajectory is in {output_file}")
+        generate_plots(data)
+
+    except SimulationError as e:
+
+        messagebox.showerror("Error", f"Error running code:\n{str(e)}")
 
     except Exception as e:
 
@@ -87,19 +155,25 @@ def run_cpp_code(react_program, selected_reactions, parameters):
 
 
 
-def generate_plots(file_path):
+def generate_plots(trajectory):
 
     """
     This function serves to generate plots regarding the chosen reactions
     by the user. The functions are made to be, by default, normalized. The
     concentrations evolution is plotted here.
 
-    This function takes a .cpp file and outputs a executable.
+    This function takes a trajectory, either the DataFrame streamed by the
+    simulation server or the path of an output file, and outputs None.
     """
 
     try:
 
-        data = pd.read_csv(file_path, delimiter='\t')
+        # Only the plotted time window is kept (and decoded, for binary files).
+        if isinstance(trajectory, pd.DataFrame):
+            time = trajectory.iloc[:, 0]
+            data = trajectory[(time >= 10e-16) & (time <= 10e-11)].reset_index(drop=True)
+        else:
+            data = read_trajectory(trajectory, 10e-16, 10e-11)
         time = data.iloc[:, 0]
 
         pop_cols = [col for col in data.columns if col.startswith("Population")]
@@ -391,6 +465,16 @@ def show_parameter_window():
         entry.pack(pady=2, anchor="w", fill="x")
         entry_widgets.append(entry)
     
+    # Output format of the trajectory.
+    binary_var = tk.BooleanVar(master=param_win)
+    tk.Checkbutton(scrollable_frame, text="Binary trajectory (output.ptraj)",
+                   variable=binary_var).pack(pady=2, anchor="w")
+
+    # Deterministic mean-field solution instead of the Monte Carlo run.
+    mean_field_var = tk.BooleanVar(master=param_win)
+    tk.Checkbutton(scrollable_frame, text="Mean-field (ODE) solution",
+                   variable=mean_field_var).pack(pady=2, anchor="w")
+
     # Function to call the function that runs the simulation
     def on_run():
         cpp_file = "src2/Plasma-Surface-Recombination.cpp"
@@ -401,7 +485,8 @@ def show_parameter_window():
             return
 
         all_values = [e.get().strip() for e in entry_widgets]
-        run_cpp_code(compiled_program, selected_reactions_global, all_values)
+        run_cpp_code(compiled_program, selected_reactions_global, all_values, binary_var.get(),
+                     mean_field_var.get())
     
     tk.Button(scrollable_frame, text="Run Code", command=on_run).pack(pady=10)
     param_win.mainloop()
@@ -0,0 +1,105 @@
+# ----------------------------------------------------- #
+# Client of the simulation server (./exec --serve). One #
+# engine process runs every simulation of a session,    #
+# so a run costs neither compilation nor process        #
+# start-up, and the trajectory comes back over the pipe #
+# instead of through output.txt.                        #
+# ----------------------------------------------------- #
+
+
+# Import of Libraries
+import struct
+import subprocess
+import numpy as np
+import pandas as pd
+
+
+class SimulationError(RuntimeError):
+
+    """
+    This class is the error raised when the server rejects or fails a run.
+    """
+
+
+class SimulationServer:
+
+    """
+    This class keeps a simulation server running and sends it runs.
+
+    Frames in both directions are a u32 little-endian length followed by the
+    payload. A request is the engine's command line, one argument per line;
+    the replies start with a tag line (HEADER, PROGRESS, ROWS, DONE or ERROR),
+    as described in src2/Server.cpp.
+    """
+
+    def __init__(self, program):
+        self.program = program
+        self.process = subprocess.Popen([program, "--serve"], stdin=subprocess.PIPE,
+                                        stdout=subprocess.PIPE)
+
+    def alive(self):
+
+        """
+        This function checks whether the server process is still running.
+        """
+
+        return self.process.poll() is None
+
+    def _send(self, payload):
+        self.process.stdin.write(struct.pack("<I", len(payload)) + payload)
+        self.process.stdin.flush()
+
+    def _receive(self):
+        head = self.process.stdout.read(4)
+        if len(head) < 4:
+            raise SimulationError("The simulation server stopped.")
+        (length,) = struct.unpack("<I", head)
+        payload = self.process.stdout.read(length)
+        tag, _, body = payload.partition(b"\n")
+        return tag.decode(), body
+
+    def run(self, arguments, on_progress=None):
+
+        """
+        This function runs one simulation.
+
+        This function takes the engine's arguments (reactions, parameters and
+        options such as "--engine=ode" or "--output=output.txt") and an
+        optional on_progress(fraction, events, events/s, ETA) callback, and
+        outputs the trajectory as a DataFrame with the columns of output.txt.
+        """
+
+        self._send("\n".join(arguments).encode())
+        columns = []
+        blocks = []
+        while True:
+            tag, body = self._receive()
+            if tag == "HEADER":
+                columns = body.decode().split("\t")
+            elif tag == "ROWS":
+                blocks.append(np.frombuffer(body, dtype="<f8").reshape(-1, len(columns)))
+            elif tag == "PROGRESS":
+                if on_progress is not None:
+                    fraction, events, rate, eta = body.split()
+                    on_progress(float(fraction), int(events), float(rate), float(eta))
+            elif tag == "DONE":
+                break
+            elif tag == "ERROR":
+                raise SimulationError(body.decode())
+
+        values = np.concatenate(blocks) if blocks else np.empty((0, len(columns)))
+        return pd.DataFrame(values, columns=columns)
+
+    def close(self):
+
+        """
+        This function stops the server.
+        """
+
+        if self.alive():
+            try:
+                self._send(b"QUIT")
+                self.process.stdin.close()
+            except OSError:
+                pass
+            self.process.wait()
@@ -0,0 +1,154 @@
+# ----------------------------------------------------- #
+# Reader for the trajectory files written by the C++    #
+# engines. Text files (.txt) are parsed with pandas,    #
+# binary files (.ptraj) are memory-mapped and only the  #
+# blocks overlapping the requested time window are      #
+# decoded.                                              #
+# ----------------------------------------------------- #
+
+
+# Import of Libraries
+import mmap
+import struct
+import numpy as np
+import pandas as pd
+
+BINARY_MAGIC = b"PSRTRJ01"
+INDEX_MAGIC = b"PSRIDX01"
+
+
+def is_binary_trajectory(file_path):
+
+    """
+    This function checks whether a file starts with the magic bytes
+    of the binary trajectory format.
+    """
+
+    with open(file_path, "rb") as f:
+        return f.read(8) == BINARY_MAGIC
+
+
+def _decode_varints(raw, count):
+
+    """
+    This function decodes 'count' zigzag varints from a byte array and
+    undoes the delta encoding, returning the absolute integer values.
+    """
+
+    b = np.frombuffer(raw, dtype=np.uint8)
+    ends = np.flatnonzero(b < 0x80)[:count]
+    starts = np.empty_like(ends)
+    starts[0] = 0
+    starts[1:] = ends[:-1] + 1
+    lengths = ends - starts + 1
+
+    values = np.zeros(count, dtype=np.uint64)
+    for k in range(int(lengths.max())):
+        mask = lengths > k
+        chunk = (b[starts[mask] + k] & 0x7f).astype(np.uint64)
+        values[mask] |= chunk << np.uint64(7 * k)
+
+    deltas = (values >> np.uint64(1)).astype(np.int64) ^ -(values & np.uint64(1)).astype(np.int64)
+    return np.cumsum(deltas)
+
+
+class BinaryTrajectory:
+
+    """
+    This class memory-maps a .ptraj file and exposes its header and
+    sparse time index. Use read(t_min, t_max) to decode a time window.
+    """
+
+    def __init__(self, file_path):
+        self._file = open(file_path, "rb")
+        self._mm = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        mm = self._mm
+
+        if mm[:8] != BINARY_MAGIC or mm[-8:] != INDEX_MAGIC:
+            raise ValueError(f"{file_path} is not a binary trajectory file")
+
+        version, flags, n_species, n_rates, n_reactions = struct.unpack_from("<5I", mm, 8)
+        self.integer_counts = bool(flags & 1)
+        self.n_species = n_species
+
+        pos = 28
+        names = []
+        for _ in range(1 + n_species + n_rates + n_reactions):
+            (length,) = struct.unpack_from("<H", mm, pos)
+            names.append(mm[pos + 2:pos + 2 + length].decode())
+            pos += 2 + length
+        self.columns = names[:1 + n_species + n_rates]
+        self.reactions = names[1 + n_species + n_rates:]
+
+        n_blocks, index_offset = struct.unpack_from("<QQ", mm, len(mm) - 24)
+        index = np.frombuffer(mm, dtype=np.dtype([("t_first", "<f8"), ("t_last", "<f8"),
+                                                  ("offset", "<u8"), ("first_row", "<u8")]),
+                              count=n_blocks, offset=index_offset)
+        # Copied so that the mapping can be closed independently of the index.
+        self.index = index.copy()
+
+    def close(self):
+        self._mm.close()
+        self._file.close()
+
+    def _read_block(self, offset):
+        mm = self._mm
+        (n_rows,) = struct.unpack_from("<I", mm, offset)
+        pos = offset + 4
+        out = []
+        for c in range(len(self.columns)):
+            if self.integer_counts and 1 <= c <= self.n_species:
+                (n_bytes,) = struct.unpack_from("<I", mm, pos)
+                pos += 4
+                out.append(_decode_varints(mm[pos:pos + n_bytes], n_rows).astype(np.float64))
+                pos += n_bytes
+            else:
+                out.append(np.frombuffer(mm, dtype="<f8", count=n_rows, offset=pos))
+                pos += 8 * n_rows
+        return out
+
+    def read(self, t_min=None, t_max=None):
+
+        """
+        This function decodes the blocks whose time range overlaps
+        [t_min, t_max] and returns the matching rows as a DataFrame
+        with the same columns as the text output.
+        """
+
+        lo = -np.inf if t_min is None else t_min
+        hi = np.inf if t_max is None else t_max
+        selected = np.flatnonzero((self.index["t_last"] >= lo) & (self.index["t_first"] <= hi))
+
+        columns = [[] for _ in self.columns]
+        for b in selected:
+            for c, values in enumerate(self._read_block(int(self.index["offset"][b]))):
+                columns[c].append(values)
+
+        data = {}
+        for name, parts in zip(self.columns, columns):
+            data[name] = np.concatenate(parts) if parts else np.empty(0)
+        frame = pd.DataFrame(data)
+        time = frame.iloc[:, 0]
+        return frame[(time >= lo) & (time <= hi)].reset_index(drop=True)
+
+
+def read_trajectory(file_path, t_min=None, t_max=None):
+
+    """
+    This function reads a trajectory written by any of the engines,
+    text or binary, optionally restricted to the window [t_min, t_max].
+    """
+
+    if is_binary_trajectory(file_path):
+        trajectory = BinaryTrajectory(file_path)
+        try:
+            return trajectory.read(t_min, t_max)
+        finally:
+            trajectory.close()
+
+    data = pd.read_csv(file_path, delimiter='\t')
+    if t_min is not None:
+        data = data[data.iloc[:, 0] >= t_min]
+    if t_max is not None:
+        data = data[data.iloc[:, 0] <= t_max]
+    return data.reset_index(drop=True)
@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+    Timing harness shared by the benchmarks.
+
+    measure() runs a case a number of times after one warm-up run and keeps
+    the median time per item and the median absolute deviation (MAD) of the
+    repeats, which are insensitive to the occasional descheduled run. Items
+    are whatever the case counts: events, steps, rows or points.
+
+    Medians can be saved to a baseline file ("<name> <ns per item>" per line)
+    and later runs compared with it; a case is reported as a regression when
+    it is slower than the baseline by more than the tolerance and by more
+    than three MADs.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchResult {
+    std::string name;
+    double medianNs = 0.0;   // per item
+    double madNs = 0.0;
+    double itemsPerSecond = 0.0;
+    const char* unit = "item";
+};
+
+inline double medianOf(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    const std::size_t n = values.size();
+    return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+// fn() performs one repeat and returns the number of items it processed.
+template <typename Fn>
+BenchResult measure(const std::string& name, const char* unit, int repeats, Fn fn)
+{
+    fn();
+    std::vector<double> samples;
+    for (int r = 0; r < repeats; r++) {
+        const auto start = std::chrono::steady_clock::now();
+        const double items = fn();
+        const auto stop = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count() / items);
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.unit = unit;
+    result.medianNs = medianOf(samples);
+    for (double& s : samples)
+        s = std::fabs(s - result.medianNs);
+    result.madNs = medianOf(samples);
+    result.itemsPerSecond = 1e9 / result.medianNs;
+    return result;
+}
+
+inline std::map<std::string, double> loadBaseline(const std::string& filename)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(filename);
+    std::string name;
+    double ns;
+    while (in >> name >> ns)
+        baseline[name] = ns;
+    return baseline;
+}
+
+inline bool saveBaseline(const std::string& filename, const std::vector<BenchResult>& results)
+{
+    // Keep the entries of cases that were not run this time.
+    std::map<std::string, double> baseline = loadBaseline(filename);
+    for (const BenchResult& r : results)
+        baseline[r.name] = r.medianNs;
+    std::ofstream out(filename);
+    out.precision(6);
+    for (const auto& entry : baseline)
+        out << entry.first << " " << entry.second << "\n";
+    return static_cast<bool>(out);
+}
+
+inline void printHeader(const char* title)
+{
+    printf("\n%s\n%-28s %14s %10s %16s %10s\n", title, "case", "median ns", "MAD %", "per second", "vs base");
+}
+
+// Prints one row, compared with the baseline when it has the case; returns
+// whether the case regressed.
+inline bool printResult(const BenchResult& r, const std::map<std::string, double>& baseline,
+                        double tolerance)
+{
+    char perSecond[32];
+    snprintf(perSecond, sizeof(perSecond), "%.3g %s/s", r.itemsPerSecond, r.unit);
+    printf("%-28s %14.1f %10.1f %16s", r.name.c_str(), r.medianNs, 100.0 * r.madNs / r.medianNs, perSecond);
+
+    auto it = baseline.find(r.name);
+    if (it == baseline.end()) {
+        printf(" %10s\n", "-");
+        return false;
+    }
+    const double change = r.medianNs / it->second - 1.0;
+    const bool regressed = change > tolerance && r.medianNs - it->second > 3.0 * r.madNs;
+    printf(" %+9.1f%%%s\n", 100.0 * change, regressed ? "  REGRESSION" : "");
+    return regressed;
+}
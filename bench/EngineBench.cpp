@@ -0,0 +1,358 @@
+/*
+    Benchmarks of the simulation engines.
+
+    Kernels: the pieces of an SSA step on the full GUI network (propensity
+    evaluation, reaction selection, state update, random draws), one RK4
+    step of the 7-reaction model, and trajectory rows written as text and
+    binary.
+
+    Workloads: complete runs with the parameters of src/main.cpp (Monte Carlo,
+    well-mixed and on lattices of 1.5e5 and 1e6 sites, batched RK4 and steady-state sweeps) and of typical GUI reaction sets
+    through every engine, with the rows discarded so only the engine is timed.
+
+    Each case reports the median time per item, its MAD and items per second.
+    Options:
+        --baseline=<file>       compare with the medians stored in <file>
+        --save-baseline=<file>  store this run's medians in <file>
+        --tolerance=<fraction>  slowdown reported as a regression (0.10)
+        --repeats=<n>           timed repeats per case (7)
+        --filter=<text>         only the cases whose name contains <text>
+    The exit status is 1 if any case regressed.
+*/
+
+#include "Bench.h"
+#include "CommandLine.h"
+#include "Random.h"
+#include "ReactionSelection.h"
+#include "TrajectoryWriter.h"
+#include "Plasma-Surface-Recombination.h"
+#include "Recombination_MC_real.h"
+#include "Recombination_Lattice.h"
+#include "Recombination_RK.h"
+#include "Recombination_SteadyState.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef pi
+#define pi 3.14159265358979323846
+#endif
+
+using namespace std;
+
+// Keeps results alive so the timed loops are not optimised away.
+static volatile double checksum = 0.0;
+
+// Counts the rows of a run (one per event with the default sampling).
+class CountingSink : public TrajectorySink {
+public:
+    void writeRow(const double* values) override
+    {
+        rows++;
+        last = values[0];
+    }
+    long long rows = 0;
+    double last = 0.0;
+};
+
+// Parameters of src/main.cpp.
+struct MainParameters {
+    double O = 1e5, Fv = 1.5e5, Sv = 3e3, A2 = 0.0;
+    double M = 16e-3, Tg = 500, Tw = 200;
+    double k1 = 1, k3 = 1, k4 = 1, vd = 1e15, vD = 1e13;
+    double Ed = 30e3, ED = 15e3, Er = 17.5e3, ELHF = 17.5e3;
+    double tstop = 1e-11;
+};
+
+// Positional arguments as GUI.py passes them to the engine.
+struct GuiNetwork {
+    const char* name;
+    vector<string> args;
+};
+
+static const vector<GuiNetwork> guiNetworks = {
+    { "basic", { "Basic", "1", "1", "1e5", "1e5", "1" } },
+    { "physisorption", { "Physisorption", "200", "500", "16e-3", "1", "1e15", "30e3",
+                         "1e5", "0", "1.5e5", "1e-9" } },
+    { "full", { "Physisorption", "Chemisorption", "Surface Diffusion",
+                "Langmuir-Hinshelwood recombination",
+                "200", "500", "16e-3", "1", "1e15", "30e3", "1", "1", "17.5e3",
+                "1e13", "15e3", "17.5e3",
+                "1e5", "0", "0", "1.5e5", "3e3", "0", "1e-9" } },
+};
+
+static ReactionNetwork networkFor(const GuiNetwork& gui)
+{
+    ReactionNetwork network;
+    string error;
+    if (!parseReactionNetwork(gui.args, network, error)) {
+        fprintf(stderr, "%s: %s\n", gui.name, error.c_str());
+        exit(1);
+    }
+    return network;
+}
+
+class BenchSuite {
+public:
+    BenchSuite(int repeats, string filter) : repeats(repeats), filter(move(filter)) {}
+
+    template <typename Fn>
+    void run(const string& name, const char* unit, Fn fn)
+    {
+        if (!filter.empty() && name.find(filter) == string::npos)
+            return;
+        results.push_back(measure(name, unit, repeats, fn));
+        if (printResult(results.back(), baseline, tolerance))
+            regressions++;
+        fflush(stdout);
+    }
+
+    int repeats;
+    string filter;
+    map<string, double> baseline;
+    double tolerance = 0.10;
+    vector<BenchResult> results;
+    int regressions = 0;
+};
+
+static void kernelBenchmarks(BenchSuite& suite)
+{
+    const ReactionNetwork network = networkFor(guiNetworks.back());
+    const ReactionTable table = compileReactionTable(network.events, network.species.size());
+    const size_t nReactions = table.nReactions;
+    // Counts and padded state (see ReactionTable) in the middle of a run.
+    vector<int64_t> n = { 90000, 40000, 2000, 110000, 1000, 5000 };
+    vector<double> x = paddedState(n);
+    vector<double> a(nReactions);
+
+    const long calls = 1000000;
+    suite.run("propensities", "call", [&]() {
+        double s = 0.0;
+        for (long i = 0; i < calls; i++) {
+            x[0] += 1.0;
+            s += table.propensities(x.data(), a.data());
+        }
+        checksum = s;
+        return static_cast<double>(calls);
+    });
+
+    const double total = table.propensities(x.data(), a.data());
+    BufferedPhilox gen(1);
+    auto uniform = [&]() { return gen.uniform(); };
+    const long selections = 1000000;
+    suite.run("select_linear", "event", [&]() {
+        LinearSelector selector(nReactions);
+        selector.reset(a.data(), total);
+        size_t s = 0;
+        for (long i = 0; i < selections; i++)
+            s += selector.select(uniform);
+        checksum = static_cast<double>(s);
+        return static_cast<double>(selections);
+    });
+    suite.run("select_tree", "event", [&]() {
+        SumTreeSelector selector(nReactions);
+        selector.reset(a.data(), total);
+        size_t s = 0;
+        for (long i = 0; i < selections; i++) {
+            const size_t j = selector.select(uniform);
+            selector.set(j, a[j]);
+            s += j;
+        }
+        checksum = static_cast<double>(s);
+        return static_cast<double>(selections);
+    });
+    suite.run("select_cr", "event", [&]() {
+        CompositionRejectionSelector selector(nReactions);
+        selector.reset(a.data(), total);
+        size_t s = 0;
+        for (long i = 0; i < selections; i++) {
+            const size_t j = selector.select(uniform);
+            selector.set(j, a[j]);
+            s += j;
+        }
+        checksum = static_cast<double>(s);
+        return static_cast<double>(selections);
+    });
+
+    const long firings = 1000000;
+    suite.run("fire", "event", [&]() {
+        vector<int64_t> m = n;
+        vector<double> y = paddedState(m);
+        for (long i = 0; i < firings; i++)
+            table.fire(m.data(), y.data(), static_cast<size_t>(i) % nReactions);
+        checksum = y[0];
+        return static_cast<double>(firings);
+    });
+
+    const long draws = 10000000;
+    suite.run("philox_uniform", "draw", [&]() {
+        BufferedPhilox g(7);
+        double s = 0.0;
+        for (long i = 0; i < draws; i++)
+            s += g.uniform();
+        checksum = s;
+        return static_cast<double>(draws);
+    });
+
+    // Rate constants of src/main.cpp, computed as RungeKuttaRecombination does.
+    const MainParameters p;
+    const double kb = 1.380649e-23, Na = 6.023e23, RT = Na * kb * p.Tw;
+    const double phi_O = 0.25 * sqrt((8 * kb * p.Tg * Na) / (pi * p.M)) * p.O;
+    const double tau_d = p.vD * exp(-p.ED / RT);
+    const double r1 = p.k1 * phi_O, r2 = p.vd * exp(-p.Ed / RT), r3 = p.k3 * phi_O;
+    const double r4 = p.k4 * exp(-p.Er / RT) * r3, r5 = 0.75 * tau_d;
+    const double r6 = tau_d * (p.k4 * exp(-p.Er / RT)), r7 = tau_d * (p.k4 * exp(-p.ELHF / RT));
+    const long steps = 1000000;
+    suite.run("rk4Step6", "step", [&]() {
+        double A = p.O, Fv = p.Fv, Af = 0.0, Sv = p.Sv, As = 0.0, A2 = 0.0, t = 0.0;
+        for (long i = 0; i < steps; i++)
+            rk4Step6(r1, r2, r3, r4, r5, r6, r7, A, Fv, Af, Sv, As, A2, t, p.tstop / 10000.0);
+        checksum = A2;
+        return static_cast<double>(steps);
+    });
+
+    TrajectoryHeader header = trajectoryHeaderFor(network.events, network.species);
+    const size_t nColumns = header.columns.size();
+    const long rows = 200000;
+    for (const char* filename : { "bench_output.txt", "bench_output.ptraj" }) {
+        const string name = trajectoryFormatFor(filename) == TrajectoryFormat::Binary ? "write_binary" : "write_text";
+        suite.run(name, "row", [&]() {
+            TrajectoryWriter writer(filename, header);
+            vector<double> row(nColumns);
+            for (long i = 0; i < rows; i++) {
+                row[0] = 1e-15 * static_cast<double>(i);
+                table.fire(n.data(), x.data(), static_cast<size_t>(i) % nReactions);
+                for (size_t s = 0; s < network.species.size(); s++)
+                    row[1 + s] = x[s];
+                table.propensities(x.data(), &row[1 + network.species.size()]);
+                writer.writeRow(row.data());
+            }
+            writer.close();
+            return static_cast<double>(rows);
+        });
+        remove(filename);
+    }
+}
+
+static void workloadBenchmarks(BenchSuite& suite)
+{
+    const MainParameters p;
+
+    RunOptions quiet;
+    quiet.seed = 1;
+    quiet.verbose = false;
+    quiet.progress = ProgressStyle::Off;
+
+    suite.run("mc_real", "event", [&]() {
+        CountingSink sink;
+        MonteCarloRecombinationReal(p.O, p.Fv, p.Sv, p.A2, p.M, p.Tg, p.Tw, p.k1, p.k3, p.k4, p.vd,
+                                    p.vD, p.Ed, p.ED, p.Er, p.ELHF, p.tstop, sink, quiet);
+        return static_cast<double>(sink.rows - 1);
+    });
+    suite.run("lattice", "event", [&]() {
+        CountingSink sink;
+        LatticeRecombination(p.O, p.Fv, p.Sv, p.A2, p.M, p.Tg, p.Tw, p.k1, p.k3, p.k4, p.vd,
+                             p.vD, p.Ed, p.ED, p.Er, p.ELHF, p.tstop, sink, quiet);
+        return static_cast<double>(sink.rows - 1);
+    });
+    // A lattice of 10^6 sites, mostly out of cache.
+    suite.run("lattice_1e6", "event", [&]() {
+        CountingSink sink;
+        LatticeRecombination(p.O, 1e6, 2e4, p.A2, p.M, p.Tg, p.Tw, p.k1, p.k3, p.k4, p.vd,
+                             p.vD, p.Ed, p.ED, p.Er, p.ELHF, p.tstop, sink, quiet);
+        return static_cast<double>(sink.rows - 1);
+    });
+
+    // The Tw sweep of src/main.cpp, 200 K to 1200 K.
+    vector<RecombinationPoint> points;
+    for (int i = 0; i < 1000; i++)
+        points.push_back({ p.O, p.Fv, p.Sv, 200.0 + i, p.Tg, p.Ed, p.ED, p.Er, p.ELHF });
+    suite.run("rk4_batch", "point", [&]() {
+        vector<RecombinationResult> results = RungeKuttaRecombinationBatch(
+            points, p.M, p.k1, p.vd, p.k3, p.k4, p.vD, p.tstop / 10000.0, p.tstop);
+        checksum = results.back().gamma_total;
+        return static_cast<double>(points.size());
+    });
+    suite.run("steady_state", "point", [&]() {
+        double s = 0.0;
+        for (const RecombinationPoint& q : points) {
+            vector<SteadyState> states = SteadyStateRecombination(q.O, q.Fv, q.Sv, p.M, q.Tg, q.Tw,
+                p.k1, p.vd, q.Ed, p.k3, p.k4, q.Er, q.ELHF, p.vD, q.ED);
+            s += states.empty() ? 0.0 : states.front().gamma_total;
+        }
+        checksum = s;
+        return static_cast<double>(points.size());
+    });
+
+    using Engine = void (*)(double, const vector<ReactionEvent>&, vector<double>&,
+                            TrajectorySink&, const SimulationOptions&);
+    struct EngineCase {
+        const char* name;
+        Engine run;
+        SelectionMethod selection;
+        const char* unit;
+    };
+    const EngineCase engines[] = {
+        { "direct", simulateMultiReaction, SelectionMethod::Linear, "event" },
+        { "direct_tree", simulateMultiReaction, SelectionMethod::SumTree, "event" },
+        { "nrm", simulateNextReaction, SelectionMethod::Linear, "event" },
+        { "tau", simulateTauLeaping, SelectionMethod::Linear, "step" },
+        { "ode", simulateMeanField, SelectionMethod::Linear, "step" },
+    };
+    for (const GuiNetwork& gui : guiNetworks) {
+        const ReactionNetwork network = networkFor(gui);
+        for (const EngineCase& engine : engines) {
+            // The other engines only on the full network.
+            if (string(engine.name) != "direct" && string(gui.name) != "full")
+                continue;
+            SimulationOptions options;
+            static_cast<RunOptions&>(options) = quiet;
+            options.selection = engine.selection;
+            suite.run(string(gui.name) + "_" + engine.name, engine.unit, [&]() {
+                CountingSink sink;
+                vector<double> state = network.initialState;
+                engine.run(network.t_stop, network.events, state, sink, options);
+                return static_cast<double>(sink.rows - 1);
+            });
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    vector<string> args;
+    map<string, string> options = extractOptions(argc, argv, args);
+
+    BenchSuite suite(options.count("repeats") ? stoi(options["repeats"]) : 7,
+                     options.count("filter") ? options["filter"] : "");
+    if (options.count("tolerance"))
+        suite.tolerance = stod(options["tolerance"]);
+    if (options.count("baseline")) {
+        suite.baseline = loadBaseline(options["baseline"]);
+        if (suite.baseline.empty())
+            printf("No baseline in %s (record one with --save-baseline=%s).\n",
+                   options["baseline"].c_str(), options["baseline"].c_str());
+    }
+
+    printHeader("Kernels");
+    kernelBenchmarks(suite);
+    printHeader("Workloads");
+    workloadBenchmarks(suite);
+
+    if (options.count("save-baseline")) {
+        if (!saveBaseline(options["save-baseline"], suite.results)) {
+            fprintf(stderr, "Could not write %s\n", options["save-baseline"].c_str());
+            return 1;
+        }
+        printf("\nBaseline written to %s\n", options["save-baseline"].c_str());
+    }
+    if (suite.regressions > 0) {
+        printf("\n%d case(s) slower than the baseline by more than %.0f%%.\n",
+               suite.regressions, 100.0 * suite.tolerance);
+        return 1;
+    }
+    return 0;
+}
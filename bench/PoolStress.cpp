@@ -0,0 +1,52 @@
+/*
+    Stress check of ThreadPool for make check-pool: many short-lived pools,
+    each flooded with trivial tasks so workers keep stealing from deques that
+    are being filled and emptied under them. Every task must run exactly once
+    and wait() must return only after the last one.
+
+        pool_stress [rounds] [threads] [tasks per round]
+
+    Exits 1 if a round loses or repeats a task.
+*/
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    const long rounds = argc > 1 ? stol(argv[1]) : 2000;
+    const size_t threads = argc > 2 ? stoul(argv[2]) : 8;
+    const long tasks = argc > 3 ? stol(argv[3]) : 2000;
+
+    const auto start = chrono::steady_clock::now();
+    for (long round = 0; round < rounds; round++) {
+        atomic<long> ran{0};
+        {
+            ThreadPool pool(threads);
+            for (long i = 0; i < tasks; i++)
+                pool.submit([&ran] { ran.fetch_add(1, memory_order_relaxed); });
+            pool.wait();
+            if (ran.load() != tasks) {
+                printf("round %ld: %ld of %ld tasks ran before wait() returned\n",
+                       round, ran.load(), tasks);
+                return 1;
+            }
+            // A second batch on the same workers, after they have gone idle.
+            for (long i = 0; i < tasks; i++)
+                pool.submit([&ran] { ran.fetch_add(1, memory_order_relaxed); });
+        }
+        if (ran.load() != 2 * tasks) {
+            printf("round %ld: %ld of %ld tasks ran\n", round, ran.load(), 2 * tasks);
+            return 1;
+        }
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%ld rounds of 2 x %ld tasks on %zu threads: all ran once (%.2f s)\n",
+           rounds, tasks, threads, seconds);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+    Long MonteCarloRecombinationReal run for bench/check_resume.sh: the
+    parameters of src/main.cpp with O = 1e7 up to t_stop = 1e-5, written to
+    mc.txt. Takes --seed, --sample-every, --checkpoint-every and --resume like
+    test, and prints the result vector with full precision so a resumed run
+    can be compared with an uninterrupted one.
+*/
+
+#include "Recombination_MC_real.h"
+#include "CommandLine.h"
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    vector<string> args;
+    map<string, string> options = extractOptions(argc, argv, args);
+
+    RunOptions run;
+    run.progress = ProgressStyle::Off;
+    run.verbose = false;
+    parseStreamOptions(options, run);
+    if (options.count("sample-every"))
+        run.sampling = SamplingPolicy::everyNEvents(stoll(options["sample-every"]));
+    if (!parseCheckpointOptions(options, args, "mc.txt", run))
+        return 1;
+
+    vector<double> result = MonteCarloRecombinationReal(
+        1e7, 1.5e5, 3e3, 0.0,
+        16e-3, 500, 200,
+        1, 1, 1, 1e15,
+        1e13, 30e3, 15e3, 17.5e3, 17.5e3,
+        1e-5, "mc.txt", run);
+    if (result.empty())
+        return 1;
+    for (double v : result)
+        printf("%.17g\n", v);
+    return 0;
+}
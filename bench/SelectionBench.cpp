@@ -0,0 +1,130 @@
+/*
+    Benchmark of the reaction selection backends in ReactionSelection.h.
+
+    A synthetic network of M channels with mass-action propensities spread
+    over six orders of magnitude is simulated for a fixed number of events.
+    The linear backend recomputes all M propensities and scans them, as the
+    direct method does; the tree and composition-rejection backends update
+    only the few channels that depend on the fired one. The crossover is the
+    smallest M for which an incremental backend beats the linear scan.
+*/
+
+#include "ReactionSelection.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Channels touched by each event in the synthetic network.
+static const int dependentsPerEvent = 4;
+
+struct SyntheticNetwork {
+    vector<double> k;
+    vector<int> r1, r2;
+    vector<double> x;
+    vector<vector<int>> dependents;
+};
+
+static SyntheticNetwork makeNetwork(size_t M, mt19937& gen)
+{
+    SyntheticNetwork net;
+    size_t nSpecies = M / 2 + 2;
+    uniform_real_distribution<> logk(-3.0, 3.0);
+    uniform_int_distribution<int> species(0, static_cast<int>(nSpecies) - 1);
+    uniform_int_distribution<int> channel(0, static_cast<int>(M) - 1);
+    net.x.assign(nSpecies, 1000.0);
+    for (size_t j = 0; j < M; j++) {
+        net.k.push_back(pow(10.0, logk(gen)));
+        net.r1.push_back(species(gen));
+        net.r2.push_back(species(gen));
+        vector<int> deps { static_cast<int>(j) };
+        for (int d = 1; d < dependentsPerEvent; d++)
+            deps.push_back(channel(gen));
+        net.dependents.push_back(deps);
+    }
+    return net;
+}
+
+// Returns nanoseconds per event.
+template <typename Selector>
+static double run(const SyntheticNetwork& net, long events, unsigned seed)
+{
+    const size_t M = net.k.size();
+    mt19937 gen(seed);
+    uniform_real_distribution<> dis(0.0, 1.0);
+    auto uniform = [&]() { return dis(gen); };
+
+    vector<double> a(M);
+    auto propensity = [&](size_t j) { return net.k[j] * net.x[net.r1[j]] * net.x[net.r2[j]]; };
+    auto recomputeAll = [&]() {
+        double total = 0.0;
+        for (size_t j = 0; j < M; j++) {
+            a[j] = propensity(j);
+            total += a[j];
+        }
+        return total;
+    };
+
+    Selector selector(M);
+    selector.reset(a.data(), recomputeAll());
+
+    size_t checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (long e = 0; e < events; e++) {
+        if (!Selector::incremental)
+            selector.reset(a.data(), recomputeAll());
+        size_t j = selector.select(uniform);
+        checksum += j;
+        // Populations stay constant so every backend sees the same distribution.
+        if (Selector::incremental) {
+            for (int d : net.dependents[j])
+                selector.set(static_cast<size_t>(d), propensity(static_cast<size_t>(d)));
+        }
+    }
+    auto stop = chrono::steady_clock::now();
+    if (checksum == static_cast<size_t>(-1))
+        printf("unreachable\n");
+    return chrono::duration<double, nano>(stop - start).count() / static_cast<double>(events);
+}
+
+template <typename Selector>
+static double medianOf(const SyntheticNetwork& net, long events, int repeats)
+{
+    vector<double> samples;
+    for (int r = 0; r < repeats; r++)
+        samples.push_back(run<Selector>(net, events, 1234u + static_cast<unsigned>(r)));
+    sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+int main()
+{
+    mt19937 gen(42);
+    const long events = 200000;
+    const int repeats = 5;
+
+    printf("%8s %12s %12s %12s   (ns/event, median of %d)\n", "M", "linear", "tree", "cr", repeats);
+    // Crossover: smallest M from which an incremental backend stays faster.
+    size_t crossover = 0;
+    for (size_t M = 4; M <= 4096; M *= 2) {
+        SyntheticNetwork net = makeNetwork(M, gen);
+        double linear = medianOf<LinearSelector>(net, events, repeats);
+        double tree = medianOf<SumTreeSelector>(net, events, repeats);
+        double cr = medianOf<CompositionRejectionSelector>(net, events, repeats);
+        printf("%8zu %12.1f %12.1f %12.1f\n", M, linear, tree, cr);
+        if (min(tree, cr) < linear) {
+            if (crossover == 0)
+                crossover = M;
+        } else {
+            crossover = 0;
+        }
+    }
+    if (crossover > 0)
+        printf("Incremental selection beats the linear scan from M = %zu channels.\n", crossover);
+    else
+        printf("The linear scan was fastest for every M tested.\n");
+    return 0;
+}
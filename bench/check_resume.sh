@@ -0,0 +1,73 @@
+#!/bin/bash
+# Checks that checkpointed runs resume bit-identically: each case is run once
+# uninterrupted, then again with --checkpoint-every and killed every
+# KILL_AFTER seconds, resumed with --resume until it completes, and the two
+# outputs are compared with cmp.
+#
+#   bench/check_resume.sh <exec> <resume_driver>
+#
+# Cases: the direct method of exec (linear, tree and cr selectors; text and
+# binary output; event-count and fixed-grid sampling) and the Monte Carlo run
+# of bench/ResumeDriver.cpp. The exit status is 1 if any case differs.
+
+EXEC=$(realpath "$1")
+DRIVER=$(realpath "$2")
+KILL_AFTER=${KILL_AFTER:-0.4}
+MAX_RESUMES=${MAX_RESUMES:-50}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+ARGS=(Physisorption Chemisorption "Surface Diffusion" "Langmuir-Hinshelwood recombination"
+      200 500 16e-3 1 1e15 30e3 1 1 17.5e3 1e13 15e3 17.5e3 1e7 0 0 1.5e5 3e3 0 1e-5)
+
+failures=0
+
+# check <name> <output> <command...>: the command runs in the current directory.
+check() {
+    local name=$1 output=$2
+    shift 2
+    rm -rf "$WORK/reference" "$WORK/resumed"
+    mkdir -p "$WORK/reference" "$WORK/resumed"
+
+    (cd "$WORK/reference" && "$@" --seed=7 > stdout.txt 2>/dev/null)
+
+    cd "$WORK/resumed"
+    # (Subshells, so the shell's "Killed" notices go to /dev/null too.)
+    (timeout -s KILL "$KILL_AFTER" "$@" --seed=7 --checkpoint-every=0.1 > stdout.txt; true) 2>/dev/null
+    local resumes=0
+    while ls ./*.checkpoint > /dev/null 2>&1 && [ $resumes -lt "$MAX_RESUMES" ]; do
+        (timeout -s KILL "$KILL_AFTER" "$@" --seed=7 --checkpoint-every=0.1 --resume > stdout.txt; true) 2>/dev/null
+        resumes=$((resumes + 1))
+    done
+    cd - > /dev/null
+
+    if cmp -s "$WORK/reference/$output" "$WORK/resumed/$output" &&
+       cmp -s "$WORK/reference/stdout.txt" "$WORK/resumed/stdout.txt"; then
+        echo "identical  $name ($resumes resumes)"
+    else
+        echo "DIFFERENT  $name ($resumes resumes)"
+        failures=$((failures + 1))
+    fi
+}
+
+for selector in linear tree cr; do
+    for format in text binary; do
+        output=output.txt
+        flags=(--quiet "--selector=$selector")
+        if [ $format = binary ]; then
+            output=output.ptraj
+            flags+=(--binary)
+        fi
+        for sampling in --sample-every=50 --sample-dt=1e-10; do
+            check "exec $selector $format $sampling" $output \
+                "$EXEC" "${ARGS[@]}" "${flags[@]}" $sampling
+        done
+    done
+done
+check "Monte Carlo --sample-every=50" mc.txt "$DRIVER" --sample-every=50
+
+if [ $failures -gt 0 ]; then
+    echo "$failures case(s) differ."
+    exit 1
+fi
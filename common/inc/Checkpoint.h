@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "RunOptions.h"
+
+// Snapshot of a run from which it can be resumed: named binary fields (state
+// vector, time, random stream position, statistics, output position, ...).
+//
+// File layout: "PSRCKP01", u32 number of fields, then per field a
+// u16-length-prefixed name, a u64 size and the bytes. save() writes to a
+// temporary file and renames it over the previous checkpoint, so a run killed
+// while saving leaves the last complete checkpoint in place.
+class Checkpoint {
+public:
+    void putBytes(const std::string& name, const std::string& bytes) { fields[name] = bytes; }
+    void putInteger(const std::string& name, std::uint64_t value);
+    void putDoubles(const std::string& name, const std::vector<double>& values);
+
+    // False if the field is missing or has the wrong size.
+    bool getBytes(const std::string& name, std::string& bytes) const;
+    bool getInteger(const std::string& name, std::uint64_t& value) const;
+    bool getDoubles(const std::string& name, std::vector<double>& values) const;
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+private:
+    std::map<std::string, std::string> fields;
+};
+
+// New checkpoint of 'run', holding its tag and random stream. Engines add
+// their state and their sink's, then save() it to run.checkpointFilename.
+Checkpoint checkpointOf(const RunOptions& run);
+
+// "output.txt" -> "output.checkpoint": the checkpoint sits next to the output.
+std::string checkpointFilenameFor(const std::string& outputFilename);
+
+// Wall-clock schedule of the checkpoints of a run. due() is meant for the
+// event loop: it reads the clock only every 4096 calls.
+class CheckpointSchedule {
+public:
+    // intervalSeconds <= 0: never due.
+    explicit CheckpointSchedule(double intervalSeconds)
+        : interval(intervalSeconds), last(Clock::now()) {}
+
+    bool due()
+    {
+        if (interval <= 0.0 || --countdown > 0)
+            return false;
+        countdown = stride;
+        const Clock::time_point now = Clock::now();
+        if (std::chrono::duration<double>(now - last).count() < interval)
+            return false;
+        last = now;
+        return true;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static const long stride = 4096;
+    double interval;
+    long countdown = stride;
+    Clock::time_point last;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "RunOptions.h"
+
+// Splits "--name" / "--name=value" options from the positional arguments.
+std::map<std::string, std::string> extractOptions(int argc, char* argv[],
+                                                  std::vector<std::string>& positional);
+// Same for arguments that did not come from argv (e.g. a server request).
+std::map<std::string, std::string> extractOptions(const std::vector<std::string>& tokens,
+                                                  std::vector<std::string>& positional);
+
+// Reads the random stream from --seed=<n>, --replica=<r> and --point=<p>.
+// Without --seed a seed is drawn from std::random_device; returns true in
+// that case so the caller can report it for replay.
+bool parseStreamOptions(const std::map<std::string, std::string>& options, RunOptions& run);
+
+// Reads the console output from --quiet (no console output but errors) and
+// --progress=bar|machine|off. Returns false for an unknown progress style.
+bool parseConsoleOptions(const std::map<std::string, std::string>& options, RunOptions& run);
+
+// Reads --checkpoint-every=<s> (save a checkpoint of the run writing
+// outputFilename every s seconds of wall time, see Checkpoint.h) and --resume
+// (continue from that checkpoint; a fresh start if there is none). The
+// checkpoint is tagged with the arguments and the options that shape the
+// trajectory, and a resume with different ones is refused. A resumed run
+// takes its random stream from the checkpoint. Returns false on an error.
+bool parseCheckpointOptions(const std::map<std::string, std::string>& options,
+                            const std::vector<std::string>& args,
+                            const std::string& outputFilename, RunOptions& run);
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TrajectoryWriter.h"
+
+// Running mean and variance (Welford).
+struct RunningStats {
+    long long n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void add(double x)
+    {
+        n++;
+        double d = x - mean;
+        mean += d / static_cast<double>(n);
+        m2 += d * (x - mean);
+    }
+    double variance() const { return n > 1 ? m2 / static_cast<double>(n - 1) : 0.0; }
+};
+
+// Streaming quantile estimate in O(1) memory (P-square algorithm of Jain &
+// Chlamtac, 1985): five markers whose heights track the p-quantile.
+class P2Quantile {
+public:
+    explicit P2Quantile(double p = 0.5);
+    void add(double x);
+    double value() const;
+
+private:
+    double p;
+    int count = 0;
+    double q[5];
+    double n[5];
+    double desired[5];
+    double increment[5];
+};
+
+// Statistics over replicas of values recorded at a fixed set of points
+// (e.g. the populations on a shared output grid). Only the accumulators are
+// kept, never the replicas themselves. add() may be called from any thread.
+class EnsembleStatistics {
+public:
+    EnsembleStatistics(std::size_t nPoints, std::size_t nValues,
+                       const std::vector<double>& quantiles = { 0.05, 0.5, 0.95 });
+
+    std::size_t numPoints() const { return nPoints; }
+    std::size_t numValues() const { return nValues; }
+
+    void add(std::size_t point, const double* values);
+
+    const RunningStats& stats(std::size_t point, std::size_t value) const
+    {
+        return moments[point * nValues + value];
+    }
+    double quantile(std::size_t point, std::size_t value, std::size_t q) const
+    {
+        return estimators[(point * nValues + value) * probabilities.size() + q].value();
+    }
+    const std::vector<double>& quantileLevels() const { return probabilities; }
+
+    // Tab-separated table: the point label, then mean, std and the quantiles
+    // of every value.
+    bool writeTable(const std::string& filename, const std::string& pointName,
+                    const std::vector<double>& pointLabels,
+                    const std::vector<std::string>& valueNames) const;
+
+private:
+    std::size_t nPoints;
+    std::size_t nValues;
+    std::vector<double> probabilities;
+    std::vector<RunningStats> moments;
+    std::vector<P2Quantile> estimators;
+    std::unique_ptr<std::mutex[]> stripes;
+    static const std::size_t nStripes = 64;
+};
+
+// Feeds the rows of one replica into an EnsembleStatistics: the n-th row goes
+// to point n, without its leading time column. The engine must sample on the
+// fixed grid shared by all replicas.
+class EnsembleGridSink : public TrajectorySink {
+public:
+    explicit EnsembleGridSink(EnsembleStatistics& grid) : grid(grid) {}
+    void writeRow(const double* values) override
+    {
+        if (row < grid.numPoints())
+            grid.add(row++, values + 1);
+    }
+
+private:
+    EnsembleStatistics& grid;
+    std::size_t row = 0;
+};
+
+// Runs 'replicas' independent runs on a work-stealing ThreadPool (0 threads:
+// one per core). run(replica, sink) writes the replica's grid rows to sink
+// and returns its final values (e.g. the recombination probabilities), which
+// are accumulated in 'finals' at point 0.
+void runEnsemble(std::size_t replicas, std::size_t threads,
+                 EnsembleStatistics& grid, EnsembleStatistics& finals,
+                 const std::function<std::vector<double>(std::size_t, TrajectorySink&)>& run);
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+// Error control of the adaptive ODE integrators.
+struct OdeTolerances {
+    double rtol = 1e-6;
+    double atol = 1e-6;
+    // First step (0: estimated from the right-hand side) and largest step.
+    double h0 = 0.0;
+    double hMax = std::numeric_limits<double>::infinity();
+    long maxSteps = 10000000;
+};
+
+struct OdeStats {
+    long accepted = 0;
+    long rejected = 0;
+    long rhsCalls = 0;
+    // Step size underflow or maxSteps reached before tEnd.
+    bool failed = false;
+};
+
+// Weighted RMS norm used for error control: sc_i = atol + rtol * max(|a_i|, |b_i|).
+template <std::size_t N>
+inline double errorNorm(const std::array<double, N>& err, const std::array<double, N>& a,
+                        const std::array<double, N>& b, const OdeTolerances& tol)
+{
+    double sum = 0.0;
+    for (std::size_t i = 0; i < N; i++) {
+        const double sc = tol.atol + tol.rtol * std::max(std::fabs(a[i]), std::fabs(b[i]));
+        sum += (err[i] / sc) * (err[i] / sc);
+    }
+    return std::sqrt(sum / static_cast<double>(N));
+}
+
+// One accepted step [t0, t1] of an adaptive integrator with its continuous
+// extension: eval(t) is the interpolated state anywhere in the step.
+template <std::size_t N>
+struct DenseStep {
+    using State = std::array<double, N>;
+    double t0 = 0.0;
+    double t1 = 0.0;
+    State y0 {};
+    State y1 {};
+    // Interpolant y0 + th * (r2 + th1 * (r3 + th * (r4 + th1 * r5))) with
+    // th = (t - t0) / (t1 - t0), th1 = 1 - th. Dormand-Prince fills all four
+    // (Hairer's contd5); the quadratic Rosenbrock interpolant only r2 and r3.
+    State r2 {}, r3 {}, r4 {}, r5 {};
+
+    State eval(double t) const
+    {
+        const double h = t1 - t0;
+        const double theta = (h > 0.0) ? (t - t0) / h : 1.0;
+        const double theta1 = 1.0 - theta;
+        State y;
+        for (std::size_t i = 0; i < N; i++)
+            y[i] = y0[i] + theta * (r2[i] + theta1 * (r3[i] + theta * (r4[i] + theta1 * r5[i])));
+        return y;
+    }
+};
+
+// Initial step from the size of y and f(y) (Hairer, Norsett & Wanner, II.4).
+template <std::size_t N, typename Rhs>
+double initialStep(Rhs& f, double t, const std::array<double, N>& y, const std::array<double, N>& dy,
+                   double tEnd, int order, const OdeTolerances& tol, OdeStats& stats)
+{
+    std::array<double, N> zero {};
+    const double d0 = errorNorm(y, y, zero, tol);
+    const double d1 = errorNorm(dy, y, zero, tol);
+    double h = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    h = std::min(h, tEnd - t);
+    std::array<double, N> y1, dy1;
+    for (std::size_t i = 0; i < N; i++)
+        y1[i] = y[i] + h * dy[i];
+    f(t + h, y1, dy1);
+    stats.rhsCalls++;
+    std::array<double, N> ddy;
+    for (std::size_t i = 0; i < N; i++)
+        ddy[i] = (dy1[i] - dy[i]) / h;
+    const double d2 = errorNorm(ddy, y, zero, tol);
+    const double dmax = std::max(d1, d2);
+    const double h1 = (dmax <= 1e-15) ? std::max(1e-6, h * 1e-3)
+                                      : std::pow(0.01 / dmax, 1.0 / (order + 1));
+    return std::min({ 100.0 * h, h1, tEnd - t, tol.hMax });
+}
+
+// Adaptive explicit Dormand-Prince 5(4) integration of y' = f(t, y) from t to
+// tEnd, with FSAL, step-size control on the embedded 4th-order error estimate
+// and 4th-order dense output. f(t, y, dydt) fills dydt; onStep(DenseStep<N>)
+// is called after every accepted step. y holds the state at tEnd on return.
+template <std::size_t N, typename Rhs, typename Observer>
+OdeStats integrateDormandPrince(Rhs f, double t, double tEnd, std::array<double, N>& y,
+                                const OdeTolerances& tol, Observer onStep)
+{
+    using State = std::array<double, N>;
+    static const double a21 = 1.0 / 5.0;
+    static const double a31 = 3.0 / 40.0, a32 = 9.0 / 40.0;
+    static const double a41 = 44.0 / 45.0, a42 = -56.0 / 15.0, a43 = 32.0 / 9.0;
+    static const double a51 = 19372.0 / 6561.0, a52 = -25360.0 / 2187.0, a53 = 64448.0 / 6561.0,
+                        a54 = -212.0 / 729.0;
+    static const double a61 = 9017.0 / 3168.0, a62 = -355.0 / 33.0, a63 = 46732.0 / 5247.0,
+                        a64 = 49.0 / 176.0, a65 = -5103.0 / 18656.0;
+    static const double a71 = 35.0 / 384.0, a73 = 500.0 / 1113.0, a74 = 125.0 / 192.0,
+                        a75 = -2187.0 / 6784.0, a76 = 11.0 / 84.0;
+    static const double c2 = 1.0 / 5.0, c3 = 3.0 / 10.0, c4 = 4.0 / 5.0, c5 = 8.0 / 9.0;
+    static const double e1 = 71.0 / 57600.0, e3 = -71.0 / 16695.0, e4 = 71.0 / 1920.0,
+                        e5 = -17253.0 / 339200.0, e6 = 22.0 / 525.0, e7 = -1.0 / 40.0;
+    static const double d1 = -12715105075.0 / 11282082432.0, d3 = 87487479700.0 / 32700410799.0,
+                        d4 = -10690763975.0 / 1880347072.0, d5 = 701980252875.0 / 199316789632.0,
+                        d6 = -1453857185.0 / 822651844.0, d7 = 69997945.0 / 29380423.0;
+
+    OdeStats stats;
+    State k1, k2, k3, k4, k5, k6, k7, ytmp, ynew, err;
+    f(t, y, k1);
+    stats.rhsCalls++;
+    double h = (tol.h0 > 0.0) ? tol.h0 : initialStep(f, t, y, k1, tEnd, 5, tol, stats);
+    double errPrev = 1e-4;  // PI controller memory
+    bool lastRejected = false;
+
+    while (t < tEnd) {
+        if (stats.accepted + stats.rejected >= tol.maxSteps || h < 1e-14 * std::fabs(t) || !(h > 0.0)) {
+            stats.failed = true;
+            break;
+        }
+        h = std::min({ h, tol.hMax, tEnd - t });
+
+        for (std::size_t i = 0; i < N; i++)
+            ytmp[i] = y[i] + h * a21 * k1[i];
+        f(t + c2 * h, ytmp, k2);
+        for (std::size_t i = 0; i < N; i++)
+            ytmp[i] = y[i] + h * (a31 * k1[i] + a32 * k2[i]);
+        f(t + c3 * h, ytmp, k3);
+        for (std::size_t i = 0; i < N; i++)
+            ytmp[i] = y[i] + h * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+        f(t + c4 * h, ytmp, k4);
+        for (std::size_t i = 0; i < N; i++)
+            ytmp[i] = y[i] + h * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+        f(t + c5 * h, ytmp, k5);
+        for (std::size_t i = 0; i < N; i++)
+            ytmp[i] = y[i] + h * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+        f(t + h, ytmp, k6);
+        for (std::size_t i = 0; i < N; i++)
+            ynew[i] = y[i] + h * (a71 * k1[i] + a73 * k3[i] + a74 * k4[i] + a75 * k5[i] + a76 * k6[i]);
+        f(t + h, ynew, k7);
+        stats.rhsCalls += 6;
+
+        for (std::size_t i = 0; i < N; i++)
+            err[i] = h * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+        const double en = errorNorm(err, y, ynew, tol);
+
+        if (en <= 1.0) {
+            DenseStep<N> step;
+            step.t0 = t;
+            step.t1 = (t + h >= tEnd) ? tEnd : t + h;
+            step.y0 = y;
+            step.y1 = ynew;
+            for (std::size_t i = 0; i < N; i++) {
+                const double ydiff = ynew[i] - y[i];
+                const double bspl = h * k1[i] - ydiff;
+                step.r2[i] = ydiff;
+                step.r3[i] = bspl;
+                step.r4[i] = ydiff - h * k7[i] - bspl;
+                step.r5[i] = h * (d1 * k1[i] + d3 * k3[i] + d4 * k4[i] + d5 * k5[i] + d6 * k6[i] + d7 * k7[i]);
+            }
+            t = step.t1;
+            y = ynew;
+            k1 = k7;  // FSAL
+            stats.accepted++;
+            onStep(static_cast<const DenseStep<N>&>(step));
+
+            // PI step-size controller (Gustafsson), no growth right after a rejection.
+            const double e = std::max(en, 1e-10);
+            double factor = 0.9 * std::pow(e, -0.7 / 5.0) * std::pow(errPrev, 0.4 / 5.0);
+            factor = std::min(std::max(factor, 0.2), lastRejected ? 1.0 : 10.0);
+            h *= factor;
+            errPrev = e;
+            lastRejected = false;
+        } else {
+            // Rejected (a NaN error estimate also fails the test above).
+            const double factor = std::isfinite(en) ? std::max(0.2, 0.9 * std::pow(en, -1.0 / 5.0)) : 0.2;
+            h *= factor;
+            stats.rejected++;
+            lastRejected = true;
+        }
+    }
+    return stats;
+}
+
+template <std::size_t N>
+using OdeMatrix = std::array<std::array<double, N>, N>;
+
+// LU factorisation with partial pivoting of a small fixed-size matrix, fully
+// unrolled by the compiler for the species counts used here.
+template <std::size_t N>
+class DenseLU {
+public:
+    // Returns false if the matrix is singular to working precision.
+    bool factor(const OdeMatrix<N>& a)
+    {
+        lu = a;
+        for (std::size_t k = 0; k < N; k++) {
+            std::size_t p = k;
+            for (std::size_t i = k + 1; i < N; i++)
+                if (std::fabs(lu[i][k]) > std::fabs(lu[p][k]))
+                    p = i;
+            if (lu[p][k] == 0.0)
+                return false;
+            pivot[k] = p;
+            if (p != k)
+                std::swap(lu[p], lu[k]);
+            const double inv = 1.0 / lu[k][k];
+            for (std::size_t i = k + 1; i < N; i++) {
+                const double m = lu[i][k] * inv;
+                lu[i][k] = m;
+                for (std::size_t j = k + 1; j < N; j++)
+                    lu[i][j] -= m * lu[k][j];
+            }
+        }
+        return true;
+    }
+
+    // Overwrites b with the solution of A x = b.
+    void solve(std::array<double, N>& b) const
+    {
+        for (std::size_t k = 0; k < N; k++) {
+            if (pivot[k] != k)
+                std::swap(b[k], b[pivot[k]]);
+            for (std::size_t i = k + 1; i < N; i++)
+                b[i] -= lu[i][k] * b[k];
+        }
+        for (std::size_t k = N; k-- > 0;) {
+            for (std::size_t j = k + 1; j < N; j++)
+                b[k] -= lu[k][j] * b[j];
+            b[k] /= lu[k][k];
+        }
+    }
+
+private:
+    OdeMatrix<N> lu {};
+    std::array<std::size_t, N> pivot {};
+};
+
+// Linearly implicit Rosenbrock 2(3) integration (the modified Rosenbrock
+// formula of Shampine & Reichelt, MATLAB's ode23s) for stiff autonomous
+// systems y' = f(y). jac(t, y, J) fills the analytic Jacobian df/dy, which is
+// evaluated and factored once per step attempt: W = I - h d J. Steps are
+// L-stable, so their size follows the accuracy of the slow dynamics rather
+// than the fastest rate. Same interface as integrateDormandPrince.
+template <std::size_t N, typename Rhs, typename Jac, typename Observer>
+OdeStats integrateRosenbrock23(Rhs f, Jac jac, double t, double tEnd, std::array<double, N>& y,
+                               const OdeTolerances& tol, Observer onStep)
+{
+    using State = std::array<double, N>;
+    const double d = 1.0 / (2.0 + std::sqrt(2.0));
+    const double e32 = 6.0 + std::sqrt(2.0);
+
+    OdeStats stats;
+    State f0, f1, f2, k1, k2, k3, ytmp, ynew, err;
+    OdeMatrix<N> J, W;
+    DenseLU<N> lu;
+    f(t, y, f0);
+    stats.rhsCalls++;
+    double h = (tol.h0 > 0.0) ? tol.h0 : initialStep(f, t, y, f0, tEnd, 2, tol, stats);
+    bool lastRejected = false;
+    bool jacobianCurrent = false;
+
+    while (t < tEnd) {
+        if (stats.accepted + stats.rejected >= tol.maxSteps || h < 1e-14 * std::fabs(t) || !(h > 0.0)) {
+            stats.failed = true;
+            break;
+        }
+        h = std::min({ h, tol.hMax, tEnd - t });
+
+        if (!jacobianCurrent) {
+            jac(t, y, J);
+            jacobianCurrent = true;
+        }
+        for (std::size_t i = 0; i < N; i++)
+            for (std::size_t j = 0; j < N; j++)
+                W[i][j] = ((i == j) ? 1.0 : 0.0) - h * d * J[i][j];
+        if (!lu.factor(W)) {
+            h *= 0.5;
+            stats.rejected++;
+            continue;
+        }
+
+        k1 = f0;
+        lu.solve(k1);
+        for (std::size_t i = 0; i < N; i++)
+            ytmp[i] = y[i] + 0.5 * h * k1[i];
+        f(t + 0.5 * h, ytmp, f1);
+        for (std::size_t i = 0; i < N; i++)
+            k2[i] = f1[i] - k1[i];
+        lu.solve(k2);
+        for (std::size_t i = 0; i < N; i++) {
+            k2[i] += k1[i];
+            ynew[i] = y[i] + h * k2[i];
+        }
+        f(t + h, ynew, f2);
+        for (std::size_t i = 0; i < N; i++)
+            k3[i] = f2[i] - e32 * (k2[i] - f1[i]) - 2.0 * (k1[i] - f0[i]);
+        lu.solve(k3);
+        stats.rhsCalls += 2;
+
+        for (std::size_t i = 0; i < N; i++)
+            err[i] = h / 6.0 * (k1[i] - 2.0 * k2[i] + k3[i]);
+        const double en = errorNorm(err, y, ynew, tol);
+
+        if (en <= 1.0) {
+            DenseStep<N> step;
+            step.t0 = t;
+            step.t1 = (t + h >= tEnd) ? tEnd : t + h;
+            step.y0 = y;
+            step.y1 = ynew;
+            for (std::size_t i = 0; i < N; i++) {
+                step.r2[i] = h * k2[i];
+                step.r3[i] = h * (k1[i] - k2[i]) / (1.0 - 2.0 * d);
+            }
+            t = step.t1;
+            y = ynew;
+            f0 = f2;  // FSAL
+            jacobianCurrent = false;
+            stats.accepted++;
+            onStep(static_cast<const DenseStep<N>&>(step));
+
+            double factor = 0.9 * std::pow(std::max(en, 1e-10), -1.0 / 3.0);
+            factor = std::min(std::max(factor, 0.2), lastRejected ? 1.0 : 5.0);
+            h *= factor;
+            lastRejected = false;
+        } else {
+            // Rejected (a NaN error estimate also fails the test above).
+            const double factor = std::isfinite(en) ? std::max(0.2, 0.9 * std::pow(en, -1.0 / 3.0)) : 0.2;
+            h *= factor;
+            stats.rejected++;
+            lastRejected = true;
+        }
+    }
+    return stats;
+}
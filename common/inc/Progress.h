@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include "RunOptions.h"
+
+// Progress of a run towards 'total' (usually t_stop), with events/s and ETA.
+//
+// update() is meant for the innermost loop: it only counts events and reads
+// the clock every 'stride' calls, adapting the stride so that the clock is
+// read about once a millisecond. Reports are written at most every
+// intervalSeconds, in run.progress style, and only when run.verbose.
+class ProgressReporter {
+public:
+    ProgressReporter(double total, const RunOptions& run, double intervalSeconds = 0.25);
+
+    void update(double progress, long long events = 1)
+    {
+        count += events;
+        if (--countdown > 0)
+            return;
+        poll(progress);
+    }
+
+    // Reports the final state and ends the bar line.
+    void finish(double progress);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void poll(double progress);
+    void report(double progress, Clock::time_point now);
+
+    ProgressStyle style;
+    std::function<void(double, long long, double, double)> callback;
+    double total;
+    double interval;
+    long long count = 0;
+    long long stride = 64;
+    long long countdown = 64;
+    Clock::time_point start;
+    Clock::time_point lastPoll;
+    Clock::time_point lastReport;
+};
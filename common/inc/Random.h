@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "RunOptions.h"
+
+// Philox4x32-10 blocks first .. first + nBlocks - 1 of the stream
+// (key, replica, point), written in order to out[4 * nBlocks]. Several blocks
+// are computed side by side so the rounds vectorise (AVX2 where available,
+// chosen at run time).
+void philoxBlocks(const std::uint32_t key[2], std::uint32_t replica, std::uint32_t point,
+                  std::uint64_t first, std::size_t nBlocks, std::uint32_t* out);
+
+// Counter-based Philox4x32-10 generator (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3", SC'11). Each output block is a pure function
+// of the key (the 64-bit seed) and a 128-bit counter made of the 64-bit block
+// index, the replica and the parameter point. Streams for different
+// (seed, replica, point) never overlap, need no shared state between threads,
+// cost nothing to create, and can be replayed or skipped ahead exactly.
+class Philox4x32 {
+public:
+    using result_type = std::uint32_t;
+
+    explicit Philox4x32(std::uint64_t seed = 0, std::uint32_t replica = 0, std::uint32_t point = 0)
+        : key { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) },
+          replica(replica),
+          point(point)
+    {
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+    result_type operator()()
+    {
+        if (used == 4) {
+            block(counter++, out);
+            used = 0;
+        }
+        return out[used++];
+    }
+
+    // Number of 32-bit outputs drawn so far.
+    std::uint64_t position() const { return counter * 4 - (4 - used); }
+
+    // Skips n outputs in O(1).
+    void discard(std::uint64_t n)
+    {
+        const std::uint64_t target = position() + n;
+        counter = target / 4;
+        used = 4;
+        if (target % 4 != 0) {
+            block(counter++, out);
+            used = static_cast<int>(target % 4);
+        }
+    }
+
+    // The four outputs of block 'index' of this stream.
+    void block(std::uint64_t index, std::uint32_t result[4]) const
+    {
+        philoxBlocks(key, replica, point, index, 1, result);
+    }
+
+private:
+    std::uint32_t key[2];
+    std::uint32_t replica;
+    std::uint32_t point;
+    std::uint64_t counter = 0;  // next block
+    std::uint32_t out[4] = { 0, 0, 0, 0 };
+    int used = 4;
+};
+
+// Same stream as Philox4x32, generated blockSize blocks at a time into a
+// buffer the engines draw from. uniform() converts two words exactly as
+// std::uniform_real_distribution<double>(0, 1) does with libstdc++, and
+// exponential() is -std::log(uniform()), so trajectories are bit-identical to
+// unbuffered draws from the same stream.
+class BufferedPhilox {
+public:
+    using result_type = std::uint32_t;
+    static const std::size_t blockSize = 256;
+
+    explicit BufferedPhilox(std::uint64_t seed = 0, std::uint32_t replica = 0, std::uint32_t point = 0)
+        : key { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) },
+          replica(replica),
+          point(point)
+    {
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+    result_type operator()()
+    {
+        if (used == words)
+            refill();
+        return buffer[used++];
+    }
+
+    // Uniform on [0, 1).
+    double uniform()
+    {
+        const double lo = (*this)();
+        const double hi = (*this)();
+        const double u = (lo + hi * 4294967296.0) * 0x1p-64;
+        return u < 1.0 ? u : 0x1.fffffffffffffp-1;
+    }
+
+    // Unit-rate exponential waiting time.
+    double exponential() { return -std::log(uniform()); }
+
+    // Number of 32-bit outputs drawn so far.
+    std::uint64_t position() const { return nextBlock * 4 - (words - used); }
+
+    // Continues the stream after 'p' outputs, as if they had been drawn.
+    void seek(std::uint64_t p)
+    {
+        nextBlock = (p / words) * blockSize;
+        refill();
+        used = static_cast<std::size_t>(p % words);
+    }
+
+private:
+    void refill()
+    {
+        philoxBlocks(key, replica, point, nextBlock, blockSize, buffer);
+        nextBlock += blockSize;
+        used = 0;
+    }
+
+    static const std::size_t words = 4 * blockSize;
+    std::uint32_t key[2];
+    std::uint32_t replica;
+    std::uint32_t point;
+    std::uint64_t nextBlock = 0;
+    std::size_t used = words;
+    std::uint32_t buffer[words];
+};
+
+// Generator used by the stochastic engines.
+using Rng = BufferedPhilox;
+
+// Stream of one run, addressed by (run.seed, run.replica, run.point).
+inline Rng makeGenerator(const RunOptions& run)
+{
+    return Rng(run.seed, static_cast<std::uint32_t>(run.replica), static_cast<std::uint32_t>(run.point));
+}
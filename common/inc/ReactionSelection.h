@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Selection backends for the direct-method SSA. All of them hold the current
+// propensities, and select(uniform) returns reaction j with probability
+// a_j / total, where uniform() draws from [0, 1). A reaction of propensity
+// zero is never returned, so its reactants need not be checked on firing.
+//
+//   LinearSelector                O(M) select, propensities recomputed in full
+//   SumTreeSelector               O(log M) select and update
+//   CompositionRejectionSelector  O(1) expected select and update (groups of
+//                                 propensities within a factor of two)
+//
+// 'incremental' tells the engine whether to update only the reactions that
+// depend on the fired one (through set) or to recompute all of them.
+// state()/restore() copy the selector exactly, round-off included, so a run
+// resumed from a checkpoint selects the same reactions.
+
+class LinearSelector {
+public:
+    static const bool incremental = false;
+
+    explicit LinearSelector(std::size_t n) : a(n, 0.0) {}
+
+    void reset(const double* values, double sum)
+    {
+        a.assign(values, values + a.size());
+        sumAll = sum;
+    }
+    void set(std::size_t j, double value)
+    {
+        sumAll += value - a[j];
+        a[j] = value;
+    }
+    double total() const { return sumAll; }
+
+    std::vector<double> state() const
+    {
+        std::vector<double> s(a);
+        s.push_back(sumAll);
+        return s;
+    }
+    bool restore(const std::vector<double>& s)
+    {
+        if (s.size() != a.size() + 1)
+            return false;
+        a.assign(s.begin(), s.end() - 1);
+        sumAll = s.back();
+        return true;
+    }
+
+    template <typename Uniform>
+    std::size_t select(Uniform& uniform) const
+    {
+        double r = uniform() * sumAll;
+        double cum = 0.0;
+        // Strictly past r, so a reaction of propensity zero is never picked.
+        for (std::size_t i = 0; i < a.size(); i++) {
+            cum += a[i];
+            if (cum > r)
+                return i;
+        }
+        // Round-off past the total: the last reaction that can fire.
+        for (std::size_t i = a.size(); i-- > 0; ) {
+            if (a[i] > 0.0)
+                return i;
+        }
+        return a.size();
+    }
+
+private:
+    std::vector<double> a;
+    double sumAll = 0.0;
+};
+
+
+// Complete binary tree of partial sums over the leaves (padded to a power of
+// two). Parents are recomputed from their children, so sums never drift.
+class SumTreeSelector {
+public:
+    static const bool incremental = true;
+
+    explicit SumTreeSelector(std::size_t n) : n(n)
+    {
+        leaves = 1;
+        while (leaves < n)
+            leaves *= 2;
+        tree.assign(2 * leaves, 0.0);
+    }
+
+    void reset(const double* values, double)
+    {
+        for (std::size_t j = 0; j < leaves; j++)
+            tree[leaves + j] = (j < n) ? values[j] : 0.0;
+        for (std::size_t i = leaves; i-- > 1; )
+            tree[i] = tree[2 * i] + tree[2 * i + 1];
+    }
+    void set(std::size_t j, double value)
+    {
+        std::size_t i = leaves + j;
+        tree[i] = value;
+        for (i /= 2; i >= 1; i /= 2)
+            tree[i] = tree[2 * i] + tree[2 * i + 1];
+    }
+    double total() const { return tree[1]; }
+
+    std::vector<double> state() const { return tree; }
+    bool restore(const std::vector<double>& s)
+    {
+        if (s.size() != tree.size())
+            return false;
+        tree = s;
+        return true;
+    }
+
+    template <typename Uniform>
+    std::size_t select(Uniform& uniform) const
+    {
+        double r = uniform() * tree[1];
+        std::size_t i = 1;
+        while (i < leaves) {
+            if (r < tree[2 * i] || tree[2 * i + 1] <= 0.0) {
+                i = 2 * i;
+            } else {
+                r -= tree[2 * i];
+                i = 2 * i + 1;
+            }
+        }
+        std::size_t j = i - leaves;
+        // Round-off can land on an empty leaf; step back to a live one.
+        while (j > 0 && tree[leaves + j] <= 0.0)
+            j--;
+        return tree[leaves + j] > 0.0 ? j : n;
+    }
+
+private:
+    std::size_t n;
+    std::size_t leaves;
+    std::vector<double> tree;
+};
+
+
+// Composition-rejection (Slepoy, Thompson & Plimpton 2008): reactions are
+// binned by the binary exponent of their propensity, a bin is chosen by a
+// short linear scan over the non-empty bins, and a member is accepted by
+// rejection with probability >= 1/2.
+class CompositionRejectionSelector {
+public:
+    static const bool incremental = true;
+
+    explicit CompositionRejectionSelector(std::size_t n)
+        : a(n, 0.0), groupOf(n, -1), slot(n, 0) {}
+
+    void reset(const double* values, double)
+    {
+        for (std::size_t j = 0; j < a.size(); j++)
+            set(j, values[j]);
+    }
+
+    void set(std::size_t j, double value)
+    {
+        int g = (value > 0.0) ? exponentOf(value) : -1;
+        if (g != groupOf[j]) {
+            if (groupOf[j] >= 0)
+                removeFromGroup(j);
+            if (g >= 0)
+                addToGroup(j, g);
+        }
+        if (g >= 0)
+            groups[static_cast<std::size_t>(g)].sum += value - a[j];
+        a[j] = value;
+        // Incremental group sums drift; refresh them every few thousand updates.
+        if (++updates % 4096 == 0)
+            resum();
+    }
+
+    double total() const
+    {
+        double s = 0.0;
+        for (int g : live)
+            s += groups[static_cast<std::size_t>(g)].sum;
+        return s;
+    }
+
+    // Propensities, update count, then per live group (in scan order) its
+    // bin, sum, size and members.
+    std::vector<double> state() const
+    {
+        std::vector<double> s(a);
+        s.push_back(static_cast<double>(updates));
+        for (int g : live) {
+            const Group& grp = groups[static_cast<std::size_t>(g)];
+            s.push_back(g);
+            s.push_back(grp.sum);
+            s.push_back(static_cast<double>(grp.members.size()));
+            for (std::size_t j : grp.members)
+                s.push_back(static_cast<double>(j));
+        }
+        return s;
+    }
+    bool restore(const std::vector<double>& s)
+    {
+        const std::size_t n = a.size();
+        if (s.size() < n + 1)
+            return false;
+        a.assign(s.begin(), s.begin() + static_cast<std::ptrdiff_t>(n));
+        updates = static_cast<unsigned long>(s[n]);
+        groups.clear();
+        live.clear();
+        groupOf.assign(n, -1);
+        for (std::size_t i = n + 1; i < s.size(); ) {
+            if (i + 3 > s.size())
+                return false;
+            const int g = static_cast<int>(s[i]);
+            const std::size_t count = static_cast<std::size_t>(s[i + 2]);
+            if (g < 0 || i + 3 + count > s.size())
+                return false;
+            if (groups.size() <= static_cast<std::size_t>(g))
+                groups.resize(static_cast<std::size_t>(g) + 1);
+            Group& grp = groups[static_cast<std::size_t>(g)];
+            grp.upper = std::ldexp(1.0, g - offset);
+            grp.sum = s[i + 1];
+            for (std::size_t k = 0; k < count; k++) {
+                const std::size_t j = static_cast<std::size_t>(s[i + 3 + k]);
+                if (j >= n)
+                    return false;
+                slot[j] = grp.members.size();
+                grp.members.push_back(j);
+                groupOf[j] = g;
+            }
+            live.push_back(g);
+            i += 3 + count;
+        }
+        return true;
+    }
+
+    template <typename Uniform>
+    std::size_t select(Uniform& uniform) const
+    {
+        if (live.empty())
+            return a.size();
+        double r = uniform() * total();
+        const Group* chosen = &groups[static_cast<std::size_t>(live.back())];
+        for (int g : live) {
+            const Group& grp = groups[static_cast<std::size_t>(g)];
+            if (r < grp.sum) {
+                chosen = &grp;
+                break;
+            }
+            r -= grp.sum;
+        }
+        const double bound = chosen->upper;
+        const std::size_t count = chosen->members.size();
+        for (;;) {
+            std::size_t k = static_cast<std::size_t>(uniform() * static_cast<double>(count));
+            if (k >= count)
+                k = count - 1;
+            std::size_t j = chosen->members[k];
+            if (uniform() * bound < a[j])
+                return j;
+        }
+    }
+
+private:
+    struct Group {
+        std::vector<std::size_t> members;
+        double sum = 0.0;
+        double upper = 0.0;  // 2^e, strict upper bound on the members' propensities
+    };
+
+    // Bin index from frexp: value in [2^(e-1), 2^e) goes to bin e + offset.
+    static const int offset = 1100;
+    static int exponentOf(double value)
+    {
+        int e;
+        std::frexp(value, &e);
+        return e + offset;
+    }
+
+    void addToGroup(std::size_t j, int g)
+    {
+        if (groups.size() <= static_cast<std::size_t>(g))
+            groups.resize(static_cast<std::size_t>(g) + 1);
+        Group& grp = groups[static_cast<std::size_t>(g)];
+        if (grp.members.empty()) {
+            grp.upper = std::ldexp(1.0, g - offset);
+            grp.sum = 0.0;
+            live.push_back(g);
+        }
+        slot[j] = grp.members.size();
+        grp.members.push_back(j);
+        groupOf[j] = g;
+    }
+
+    void removeFromGroup(std::size_t j)
+    {
+        Group& grp = groups[static_cast<std::size_t>(groupOf[j])];
+        grp.sum -= a[j];
+        std::size_t last = grp.members.back();
+        grp.members[slot[j]] = last;
+        slot[last] = slot[j];
+        grp.members.pop_back();
+        if (grp.members.empty()) {
+            for (std::size_t i = 0; i < live.size(); i++) {
+                if (live[i] == groupOf[j]) {
+                    live[i] = live.back();
+                    live.pop_back();
+                    break;
+                }
+            }
+        }
+        groupOf[j] = -1;
+        a[j] = 0.0;
+    }
+
+    void resum()
+    {
+        for (int g : live) {
+            Group& grp = groups[static_cast<std::size_t>(g)];
+            grp.sum = 0.0;
+            for (std::size_t j : grp.members)
+                grp.sum += a[j];
+        }
+    }
+
+    std::vector<double> a;
+    std::vector<int> groupOf;
+    std::vector<std::size_t> slot;
+    std::vector<Group> groups;
+    std::vector<int> live;
+    unsigned long updates = 0;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "Sampling.h"
+
+// How a run reports its progress (see ProgressReporter): a redrawn bar on
+// stdout, one "PROGRESS ..." line per report on stderr, a call of
+// RunOptions::progressCallback (the simulation server), or nothing.
+enum class ProgressStyle { Bar, Machine, Callback, Off };
+
+class Checkpoint;
+
+// Settings common to every engine run.
+struct RunOptions {
+    SamplingPolicy sampling;
+    // Random stream (see makeGenerator in Random.h): the same
+    // (seed, replica, point) always gives the same trajectory.
+    std::uint64_t seed = 0;
+    std::uint64_t replica = 0;
+    std::uint64_t point = 0;
+    // Convergence stop (engines with time-averaged estimators): end the run
+    // before t_stop once the estimate is stationary and its 95% half-width is
+    // within 'precision' relative to it (0: off), or as soon as it is
+    // stationary with stopAtSteadyState.
+    double precision = 0.0;
+    bool stopAtSteadyState = false;
+    // Progress and summary output on the console; off for ensemble replicas
+    // and with --quiet.
+    bool verbose = true;
+    ProgressStyle progress = ProgressStyle::Bar;
+    // ProgressStyle::Callback: receives (fraction, events, events/s, ETA s or -1).
+    std::function<void(double, long long, double, double)> progressCallback;
+    // Performance report (see RunReport) written here as JSON; empty: none.
+    std::string reportFilename;
+    // Checkpoints (engines that support them, see Checkpoint.h): the run's
+    // state is saved to checkpointFilename every checkpointInterval seconds of
+    // wall time (0: never), tagged with checkpointTag. A run given resumeFrom
+    // continues from that checkpoint instead of starting at t = 0. Whoever
+    // closes the output removes the checkpoint once the output is complete.
+    std::string checkpointFilename;
+    double checkpointInterval = 0.0;
+    std::string checkpointTag;
+    std::shared_ptr<const Checkpoint> resumeFrom;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Checkpoint;
+
+// Parts of an engine step whose cost RunReport estimates.
+enum class RunPhase { Propensities, Selection, Update, Output, Statistics };
+
+// Performance summary of one engine run: firings per reaction, steps and
+// events per second, where the time goes, and (on Linux, when the kernel
+// allows it) hardware counters of the running thread from perf_event_open.
+//
+// Counting is always on and costs one increment per event. Phase timing is
+// sampled: on average one step in sampleEvery is timed with beginStep()/
+// phaseDone(), each call charging the time since the previous mark to a
+// phase. The gaps between timed steps are random (from a generator of the
+// report's own, not the run's), so the timed steps cannot lock onto periodic
+// work such as a full output buffer every 8192 rows. The untimed steps between
+// two timed ones are timed as a block, which gives the cost of a step without
+// the clock reads; the phases split that cost in proportion to their sampled
+// times. A disabled report never reads the clock.
+class RunReport {
+public:
+    RunReport(std::string engine, std::vector<std::string> reactions, bool enabled,
+              std::size_t sampleEvery = 64);
+    ~RunReport();
+    RunReport(const RunReport&) = delete;
+    RunReport& operator=(const RunReport&) = delete;
+
+    void beginStep()
+    {
+        steps++;
+        timing = (--countdown == 0);
+        if (timing) {
+            countdown = nextGap();
+            const Clock::time_point now = Clock::now();
+            // Since the end of the previous timed step, nothing but untimed steps.
+            if (sampledSteps > 0) {
+                untimedSeconds += std::chrono::duration<double>(now - mark).count() - clockOverhead;
+                untimedSteps += steps - lastSampledStep - 1;
+            }
+            sampledSteps++;
+            lastSampledStep = steps;
+            mark = now;
+        }
+    }
+
+    void phaseDone(RunPhase phase)
+    {
+        if (!timing)
+            return;
+        const Clock::time_point now = Clock::now();
+        const std::size_t p = static_cast<std::size_t>(phase);
+        phaseSeconds[p] += std::chrono::duration<double>(now - mark).count();
+        phaseMarks[p]++;
+        mark = now;
+    }
+
+    // Reaction j fired n times (or, for ODE solvers, advanced by an extent n).
+    void fired(std::size_t j, double n = 1.0) { counts[j] += n; }
+
+    std::uint64_t stepCount() const { return steps; }
+
+    // Firings so far, for checkpoints. A resumed run counts the firings of
+    // the whole trajectory; steps and timings cover the resumed part only.
+    void saveTo(Checkpoint& checkpoint) const;
+    bool restoreFrom(const Checkpoint& checkpoint);
+
+    // Engine-specific figures, e.g. derivative evaluations.
+    void set(const std::string& name, double value);
+
+    // Stops the clocks and counters at simulated time t.
+    void finish(double t);
+
+    // Writes the summary as JSON; returns false if the file cannot be opened.
+    bool writeJson(const std::string& filename) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static const std::size_t nPhases = 5;
+
+    // Steps to the next timed one: uniform on [1, 2 sampleEvery - 1].
+    std::uint64_t nextGap()
+    {
+        gapState ^= gapState << 13;
+        gapState ^= gapState >> 7;
+        gapState ^= gapState << 17;
+        return 1 + gapState % (2 * sampleEvery - 1);
+    }
+
+    std::string engine;
+    std::vector<std::string> reactions;
+    std::vector<double> counts;
+    std::size_t sampleEvery;
+    std::uint64_t countdown;
+    bool timing = false;
+    std::uint64_t steps = 0;
+    std::uint64_t sampledSteps = 0;
+    std::uint64_t lastSampledStep = 0;
+    std::uint64_t gapState = 0x9E3779B97F4A7C15ull;
+    // Wall time and number of the steps between timed ones.
+    double untimedSeconds = 0.0;
+    std::uint64_t untimedSteps = 0;
+    std::array<double, nPhases> phaseSeconds {};
+    std::array<std::uint64_t, nPhases> phaseMarks {};
+    // Cost of one clock read, taken off every timed phase.
+    double clockOverhead = 0.0;
+    Clock::time_point start;
+    Clock::time_point mark;
+    double wallSeconds = 0.0;
+    double simulatedTime = 0.0;
+    std::vector<std::pair<std::string, double>> extras;
+
+    // perf_event_open file descriptors (-1: unavailable) and final values.
+    std::vector<int> counterFds;
+    std::vector<std::pair<std::string, std::uint64_t>> counterValues;
+    std::string countersUnavailable;
+};
+
+// "output.txt" -> "output.report.json": the report sits next to the output.
+std::string reportFilenameFor(const std::string& outputFilename);
@@ -0,0 +1,48 @@
+#pragma once
+
+class Checkpoint;
+
+// Which states of a run are written to the trajectory.
+struct SamplingPolicy {
+    enum Mode {
+        EveryEvent,     // every SSA event / integration step (default)
+        FixedInterval,  // on the grid 0, dt, 2 dt, ... (state held between events)
+        EveryNEvents,   // every N-th event / step
+        OnChange        // whenever the watched population changes
+    };
+    Mode mode = EveryEvent;
+    double interval = 0.0;
+    long long everyN = 1;
+    int species = 0;  // watched population (index into the state) for OnChange
+
+    static SamplingPolicy fixedInterval(double dt);
+    static SamplingPolicy everyNEvents(long long n);
+    static SamplingPolicy onChange(int species);
+};
+
+// Decides when an engine records a row. The initial state at t = 0 is always
+// written by the engine itself.
+class TrajectorySampler {
+public:
+    explicit TrajectorySampler(const SamplingPolicy& policy);
+
+    bool fixedGrid() const { return policy.mode == SamplingPolicy::FixedInterval; }
+
+    // Fixed grid: returns the next unwritten grid time strictly before tNext
+    // (or up to and including it for gridPointUpTo), advancing the grid.
+    bool gridPointBefore(double tNext, double& tGrid);
+    bool gridPointUpTo(double tEnd, double& tGrid);
+
+    // Event-driven modes: whether the state after an event should be written.
+    // 'before'/'after' are the watched population around the event.
+    bool recordEvent(double before, double after);
+
+    // Position on the grid / in the event count, for checkpoints.
+    void saveTo(Checkpoint& checkpoint) const;
+    bool restoreFrom(const Checkpoint& checkpoint);
+
+private:
+    SamplingPolicy policy;
+    long long gridIndex = 1;
+    long long eventCount = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Values taken by one swept parameter.
+struct SweepAxis {
+    std::string name;
+    std::vector<double> values;
+};
+
+// Range of one parameter in a Latin-hypercube design.
+struct SweepRange {
+    std::string name;
+    double lo = 0.0;
+    double hi = 0.0;
+};
+
+// Parses "v" (fixed), "a,b,c" (list) or "lo:hi:n" (n evenly spaced values).
+SweepAxis parseSweepAxis(const std::string& name, const std::string& spec);
+
+// Ordered list of parameter points to simulate.
+struct SweepDesign {
+    std::vector<std::string> names;
+    std::vector<std::vector<double>> points;
+
+    // Full factorial grid; the first axis varies fastest, so the points of
+    // one curve (e.g. gamma(Tw) for a given energy set) are contiguous.
+    static SweepDesign grid(const std::vector<SweepAxis>& axes);
+
+    // n points, one per stratum of every range, strata paired at random.
+    static SweepDesign latinHypercube(const std::vector<SweepRange>& ranges,
+                                      std::size_t n, std::uint64_t seed);
+};
+
+// Runs evaluate(index, point) for every point of the design on a work-stealing
+// ThreadPool (0 threads: one per core). Each task gets only its own index and
+// point, so any per-point output must be named after the index. The table
+// (parameter columns, then resultNames) is written in design order as soon as
+// the leading points complete, and flushed row by row. Returns false if the
+// table cannot be opened.
+bool runSweep(const SweepDesign& design, std::size_t threads,
+              const std::string& tableFilename,
+              const std::vector<std::string>& resultNames,
+              const std::function<std::vector<double>(std::size_t, const std::vector<double>&)>& evaluate);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing thread pool. Each worker owns a deque: it runs its
+// own tasks from the front, in submission order, and when it runs dry steals
+// from the back of the other workers' deques, i.e. the most recently submitted
+// work. Tasks submitted from outside are dealt round-robin, so batches complete
+// roughly in submission order.
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread.
+    explicit ThreadPool(std::size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const { return workers.size(); }
+
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished.
+    void wait();
+
+private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(std::size_t self);
+    bool popOrSteal(std::size_t self, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::size_t nextQueue = 0;
+
+    std::mutex stateMtx;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    std::size_t queued = 0;      // in a deque, not yet claimed by a worker
+    std::size_t unfinished = 0;  // submitted, not yet completed
+    bool stopping = false;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Checkpoint;
+
+// Time averages of several piecewise-constant signals with batch-means
+// confidence intervals, in O(1) memory.
+//
+// Time is cut into batches of equal length. At most maxBatches completed
+// batches are kept; when they fill, adjacent pairs merge and the batch length
+// doubles. The first batch length is 8 times the first interval added.
+// Estimates use the later half of the completed batches, so the initial
+// transient is discarded along with the first half of the run.
+class TimeAverages {
+public:
+    explicit TimeAverages(std::size_t nChannels, std::size_t maxBatches = 64);
+
+    // values[0..nChannels) were held over an interval of length dt (split
+    // across batch boundaries). Returns true when this completed a batch.
+    bool add(const double* values, double dt);
+
+    std::size_t batches() const { return nBatches; }
+    // Batches the estimates are taken from (the later half).
+    std::size_t windowBatches() const { return nBatches - nBatches / 2; }
+
+    // Time average of channel c over the window (0 without completed batches).
+    double mean(std::size_t c) const;
+    // Half-width z * s / sqrt(n) of the batch means over the window; infinite
+    // with fewer than minBatches window batches.
+    double halfWidth(std::size_t c, double z = 1.96) const;
+    // No trend: the second and last quarters of the run agree within z
+    // standard errors.
+    bool stationary(std::size_t c, double z = 1.96) const;
+
+    static const std::size_t minBatches = 8;
+
+    // Batches and the partial one, under "<name>." keys, for checkpoints.
+    void saveTo(Checkpoint& checkpoint, const std::string& name) const;
+    bool restoreFrom(const Checkpoint& checkpoint, const std::string& name);
+
+private:
+    // Time average of channel c over batches [first, last).
+    double windowMean(std::size_t c, std::size_t first, std::size_t last) const;
+    double batchMean(std::size_t c, std::size_t b) const
+    {
+        return integrals[b * nChannels + c] / durations[b];
+    }
+
+    std::size_t nChannels;
+    std::size_t maxBatches;
+    std::size_t nBatches = 0;
+    double batchLength = 0.0;
+    std::vector<double> integrals;   // maxBatches x nChannels
+    std::vector<double> durations;   // maxBatches
+    std::vector<double> partial;     // integrals of the current batch
+    double partialDuration = 0.0;
+
+    void closeBatch();
+};
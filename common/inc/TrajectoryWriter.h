@@ -0,0 +1,148 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Checkpoint;
+
+// Column layout of a trajectory: Time, nSpecies populations, then one
+// propensity column per reaction.
+struct TrajectoryHeader {
+    std::vector<std::string> columns;
+    std::size_t nSpecies = 0;
+    // Populations are whole numbers (stochastic engines) and can be stored
+    // as delta/varint-encoded integers in the binary format.
+    bool integerCounts = true;
+    // Optional human-readable reactions, e.g. "A + Fv -> Af".
+    std::vector<std::string> reactions;
+};
+
+enum class TrajectoryFormat { Text, Binary };
+
+// Files ending in ".ptraj" are written in the binary format, anything else as TSV.
+TrajectoryFormat trajectoryFormatFor(const std::string& filename);
+
+// Name of a file kept next to an output: its extension replaced by suffix,
+// e.g. ("output.txt", ".report.json") -> "output.report.json".
+std::string filenameNextTo(const std::string& outputFilename, const std::string& suffix);
+
+// Destination for the sampled rows of a run (Time, populations, rates).
+class TrajectorySink {
+public:
+    virtual ~TrajectorySink() = default;
+    virtual void writeRow(const double* values) = 0;
+    // Saves the output position so that a resumed run can continue the same
+    // output; false if this sink cannot be resumed.
+    virtual bool saveTo(Checkpoint&) { return false; }
+};
+
+// Discards every row, for runs where only the final results are wanted.
+class NullTrajectorySink : public TrajectorySink {
+public:
+    void writeRow(const double*) override {}
+    bool saveTo(Checkpoint&) override { return true; }
+};
+
+// Streams fixed-width rows of doubles to a trajectory file.
+//
+// The simulation thread only copies raw values into the active buffer. When it
+// fills, the buffers are swapped and a background thread formats and writes
+// the full one, so memory use is bounded by two buffers whatever the run
+// length. The producer only waits if the disk cannot keep up with it.
+//
+// Binary layout (little-endian), read by Trajectory.py:
+//   "PSRTRJ01", u32 version, u32 flags (bit 0: integer counts),
+//   u32 nSpecies, u32 nRates, u32 nReactions, then u16-length-prefixed
+//   column names followed by the reaction descriptions.
+//   Blocks, one per flushed buffer: u32 nRows, f64 times[nRows], then per
+//   species either u32 nBytes + zigzag varint deltas (first row relative to
+//   zero) or f64[nRows], then f64[nRows] per rate column.
+//   Index: per block f64 tFirst, f64 tLast, u64 offset, u64 firstRow.
+//   Footer: u64 nBlocks, u64 indexOffset, "PSRIDX01".
+//
+// saveTo() waits for the I/O thread and records the file length, the block
+// index and the rows still buffered. The resume constructor truncates the
+// file back to that length and restores the rest, so the finished file is
+// byte-identical to one written without interruption.
+class TrajectoryWriter : public TrajectorySink {
+public:
+    TrajectoryWriter(const std::string& filename,
+                     const TrajectoryHeader& header,
+                     TrajectoryFormat format,
+                     std::size_t rowsPerBuffer = 8192);
+    TrajectoryWriter(const std::string& filename, const TrajectoryHeader& header)
+        : TrajectoryWriter(filename, header, trajectoryFormatFor(filename)) {}
+    // Continues the file from a checkpoint taken with saveTo().
+    TrajectoryWriter(const std::string& filename, const TrajectoryHeader& header,
+                     const Checkpoint& checkpoint);
+    ~TrajectoryWriter() override;
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    bool good() const { return opened; }
+    std::size_t numColumns() const { return nColumns; }
+
+    // Returns storage for the next row; fill numColumns() values, then commitRow().
+    double* nextRow() { return &buffers[active][fill * nColumns]; }
+    void commitRow()
+    {
+        if (++fill == rowsPerBuffer)
+            swapBuffers();
+    }
+    // Does nothing if the file could not be opened.
+    void writeRow(const double* values) override;
+    bool saveTo(Checkpoint& checkpoint) override;
+
+    // Flushes all pending rows and stops the I/O thread.
+    void close();
+
+private:
+    struct BlockIndex {
+        double tFirst;
+        double tLast;
+        std::uint64_t offset;
+        std::uint64_t firstRow;
+    };
+
+    void startIo();
+    void swapBuffers();
+    void ioLoop();
+    void writeTextHeader();
+    void writeBinaryHeader();
+    void writeBinaryIndex();
+    void formatRows(const std::vector<double>& rows, std::size_t nRows);
+    void encodeBlock(const std::vector<double>& rows, std::size_t nRows);
+
+    std::ofstream out;
+    bool opened;
+    TrajectoryHeader header;
+    TrajectoryFormat format;
+    std::size_t nColumns;
+    std::size_t rowsPerBuffer;
+
+    std::vector<double> buffers[2];
+    int active = 0;
+    std::size_t fill = 0;
+
+    // Hand-off to the I/O thread: at most one buffer is pending at a time.
+    std::mutex mtx;
+    std::condition_variable cv;
+    int pending = -1;
+    std::size_t pendingRows = 0;
+    bool stopping = false;
+    bool closed = false;
+    std::thread io;
+
+    // Owned by the I/O thread.
+    std::vector<char> text;
+    std::vector<BlockIndex> blocks;
+    std::uint64_t bytesWritten = 0;
+    std::uint64_t rowsWritten = 0;
+};
@@ -0,0 +1,117 @@
+#include "Checkpoint.h"
+#include "TrajectoryWriter.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+static const char checkpointMagic[8] = { 'P', 'S', 'R', 'C', 'K', 'P', '0', '1' };
+
+void Checkpoint::putInteger(const string& name, uint64_t value)
+{
+    fields[name] = string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Checkpoint::putDoubles(const string& name, const vector<double>& values)
+{
+    fields[name] = string(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+}
+
+bool Checkpoint::getBytes(const string& name, string& bytes) const
+{
+    auto it = fields.find(name);
+    if (it == fields.end())
+        return false;
+    bytes = it->second;
+    return true;
+}
+
+bool Checkpoint::getInteger(const string& name, uint64_t& value) const
+{
+    auto it = fields.find(name);
+    if (it == fields.end() || it->second.size() != sizeof(value))
+        return false;
+    memcpy(&value, it->second.data(), sizeof(value));
+    return true;
+}
+
+bool Checkpoint::getDoubles(const string& name, vector<double>& values) const
+{
+    auto it = fields.find(name);
+    if (it == fields.end() || it->second.size() % sizeof(double) != 0)
+        return false;
+    values.resize(it->second.size() / sizeof(double));
+    if (!values.empty())
+        memcpy(values.data(), it->second.data(), it->second.size());
+    return true;
+}
+
+bool Checkpoint::save(const string& filename) const
+{
+    const string tmp = filename + ".tmp";
+    {
+        ofstream out(tmp, ios::binary);
+        if (!out)
+            return false;
+        out.write(checkpointMagic, sizeof(checkpointMagic));
+        const uint32_t count = static_cast<uint32_t>(fields.size());
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& field : fields) {
+            const uint16_t nameLength = static_cast<uint16_t>(field.first.size());
+            const uint64_t size = field.second.size();
+            out.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+            out.write(field.first.data(), nameLength);
+            out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            out.write(field.second.data(), static_cast<streamsize>(size));
+        }
+        out.flush();
+        if (!out)
+            return false;
+    }
+    error_code ec;
+    filesystem::rename(tmp, filename, ec);
+    return !ec;
+}
+
+bool Checkpoint::load(const string& filename)
+{
+    ifstream in(filename, ios::binary);
+    char magic[sizeof(checkpointMagic)];
+    uint32_t count = 0;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, checkpointMagic, sizeof(magic)) != 0 ||
+        !in.read(reinterpret_cast<char*>(&count), sizeof(count)))
+        return false;
+
+    map<string, string> loaded;
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t nameLength = 0;
+        uint64_t size = 0;
+        if (!in.read(reinterpret_cast<char*>(&nameLength), sizeof(nameLength)))
+            return false;
+        string name(nameLength, '\0');
+        if (!in.read(&name[0], nameLength) || !in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+            return false;
+        string bytes(static_cast<size_t>(size), '\0');
+        if (size > 0 && !in.read(&bytes[0], static_cast<streamsize>(size)))
+            return false;
+        loaded[name] = move(bytes);
+    }
+    fields = move(loaded);
+    return true;
+}
+
+Checkpoint checkpointOf(const RunOptions& run)
+{
+    Checkpoint checkpoint;
+    checkpoint.putBytes("tag", run.checkpointTag);
+    checkpoint.putInteger("stream.seed", run.seed);
+    checkpoint.putInteger("stream.replica", run.replica);
+    checkpoint.putInteger("stream.point", run.point);
+    return checkpoint;
+}
+
+string checkpointFilenameFor(const string& outputFilename)
+{
+    return filenameNextTo(outputFilename, ".checkpoint");
+}
@@ -0,0 +1,128 @@
+#include "CommandLine.h"
+#include "Checkpoint.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+
+using namespace std;
+
+map<string, string> extractOptions(int argc, char* argv[], vector<string>& positional)
+{
+    return extractOptions(vector<string>(argv + min(argc, 1), argv + argc), positional);
+}
+
+map<string, string> extractOptions(const vector<string>& tokens, vector<string>& positional)
+{
+    map<string, string> options;
+    for (const string& token : tokens) {
+        if (token.size() > 2 && token.compare(0, 2, "--") == 0) {
+            size_t eq = token.find('=');
+            if (eq == string::npos)
+                options[token.substr(2)] = "";
+            else
+                options[token.substr(2, eq - 2)] = token.substr(eq + 1);
+        } else {
+            positional.push_back(token);
+        }
+    }
+    return options;
+}
+
+bool parseStreamOptions(const map<string, string>& options, RunOptions& run)
+{
+    auto seed = options.find("seed");
+    auto replica = options.find("replica");
+    auto point = options.find("point");
+    if (replica != options.end())
+        run.replica = stoull(replica->second);
+    if (point != options.end())
+        run.point = stoull(point->second);
+    if (seed != options.end()) {
+        run.seed = stoull(seed->second);
+        return false;
+    }
+    random_device rd;
+    run.seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+    return true;
+}
+
+bool parseConsoleOptions(const map<string, string>& options, RunOptions& run)
+{
+    auto progress = options.find("progress");
+    if (progress != options.end()) {
+        if (progress->second == "bar") {
+            run.progress = ProgressStyle::Bar;
+        } else if (progress->second == "machine") {
+            run.progress = ProgressStyle::Machine;
+        } else if (progress->second == "off") {
+            run.progress = ProgressStyle::Off;
+        } else {
+            cerr << "Unknown progress style: " << progress->second << "\n";
+            return false;
+        }
+    }
+    if (options.count("quiet")) {
+        run.verbose = false;
+        run.progress = ProgressStyle::Off;
+    }
+    return true;
+}
+
+bool parseCheckpointOptions(const map<string, string>& options, const vector<string>& args,
+                            const string& outputFilename, RunOptions& run)
+{
+    auto every = options.find("checkpoint-every");
+    const bool resume = options.count("resume") > 0;
+    if (every == options.end() && !resume)
+        return true;
+    if (every != options.end()) {
+        try {
+            run.checkpointInterval = stod(every->second);
+        } catch (const exception&) {
+            cerr << "Invalid --checkpoint-every: " << every->second << "\n";
+            return false;
+        }
+    }
+    run.checkpointFilename = checkpointFilenameFor(outputFilename);
+
+    // Options that do not change the trajectory stay out of the tag.
+    static const set<string> untagged = { "seed", "replica", "point", "quiet", "progress", "report",
+                                          "threads", "checkpoint-every", "resume" };
+    string tag;
+    for (const string& arg : args)
+        tag += arg + "\n";
+    for (const auto& option : options)
+        if (!untagged.count(option.first))
+            tag += "--" + option.first + "=" + option.second + "\n";
+    run.checkpointTag = tag;
+
+    if (!resume)
+        return true;
+    auto checkpoint = make_shared<Checkpoint>();
+    if (!checkpoint->load(run.checkpointFilename)) {
+        cerr << "No checkpoint in " << run.checkpointFilename << "; starting from t = 0.\n";
+        return true;
+    }
+    string savedTag;
+    uint64_t seed, replica, point;
+    if (!checkpoint->getBytes("tag", savedTag) || !checkpoint->getInteger("stream.seed", seed) ||
+        !checkpoint->getInteger("stream.replica", replica) || !checkpoint->getInteger("stream.point", point)) {
+        cerr << "Unreadable checkpoint: " << run.checkpointFilename << "\n";
+        return false;
+    }
+    if (savedTag != tag) {
+        cerr << run.checkpointFilename << " was written by a run with other arguments or options.\n";
+        return false;
+    }
+    if (options.count("seed") && run.seed != seed) {
+        cerr << run.checkpointFilename << " continues the stream of --seed=" << seed << ".\n";
+        return false;
+    }
+    run.seed = seed;
+    run.replica = replica;
+    run.point = point;
+    run.resumeFrom = checkpoint;
+    return true;
+}
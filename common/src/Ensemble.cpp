@@ -0,0 +1,170 @@
+#include "Ensemble.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// Insertion sort for the at most five marker heights.
+static void sortMarkers(double* v, int n)
+{
+    for (int i = 1; i < n; i++)
+        for (int j = i; j > 0 && v[j] < v[j - 1]; j--)
+            swap(v[j], v[j - 1]);
+}
+
+P2Quantile::P2Quantile(double p_)
+    : p(p_)
+{
+    for (int i = 0; i < 5; i++) {
+        q[i] = 0.0;
+        n[i] = i + 1;
+    }
+    desired[0] = 1;
+    desired[1] = 1 + 2 * p;
+    desired[2] = 1 + 4 * p;
+    desired[3] = 3 + 2 * p;
+    desired[4] = 5;
+    increment[0] = 0;
+    increment[1] = p / 2;
+    increment[2] = p;
+    increment[3] = (1 + p) / 2;
+    increment[4] = 1;
+}
+
+void P2Quantile::add(double x)
+{
+    if (count < 5) {
+        q[count++] = x;
+        if (count == 5)
+            sortMarkers(q, 5);
+        return;
+    }
+    count++;
+
+    int k;
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    } else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (k < 3 && x >= q[k + 1])
+            k++;
+    }
+    for (int i = k + 1; i < 5; i++)
+        n[i] += 1;
+    for (int i = 0; i < 5; i++)
+        desired[i] += increment[i];
+
+    // Move the middle markers towards their desired positions.
+    for (int i = 1; i <= 3; i++) {
+        double d = desired[i] - n[i];
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+            double s = (d > 0) ? 1.0 : -1.0;
+            double parabolic = q[i] + s / (n[i + 1] - n[i - 1]) *
+                ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                 (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+            if (q[i - 1] < parabolic && parabolic < q[i + 1]) {
+                q[i] = parabolic;
+            } else {
+                int j = i + static_cast<int>(s);
+                q[i] += s * (q[j] - q[i]) / (n[j] - n[i]);
+            }
+            n[i] += s;
+        }
+    }
+}
+
+double P2Quantile::value() const
+{
+    if (count == 0)
+        return 0.0;
+    if (count < 5) {
+        // Exact quantile of the few samples seen so far.
+        double sorted[5];
+        copy(q, q + count, sorted);
+        sortMarkers(sorted, count);
+        int idx = static_cast<int>(lround(p * (count - 1)));
+        return sorted[idx];
+    }
+    return q[2];
+}
+
+
+EnsembleStatistics::EnsembleStatistics(size_t nPoints_, size_t nValues_,
+                                       const vector<double>& quantiles)
+    : nPoints(nPoints_),
+      nValues(nValues_),
+      probabilities(quantiles),
+      moments(nPoints_ * nValues_),
+      stripes(new mutex[nStripes])
+{
+    estimators.reserve(nPoints * nValues * probabilities.size());
+    for (size_t i = 0; i < nPoints * nValues; i++)
+        for (double p : probabilities)
+            estimators.emplace_back(p);
+}
+
+void EnsembleStatistics::add(size_t point, const double* values)
+{
+    lock_guard<mutex> lock(stripes[point % nStripes]);
+    const size_t nq = probabilities.size();
+    for (size_t v = 0; v < nValues; v++) {
+        size_t cell = point * nValues + v;
+        moments[cell].add(values[v]);
+        for (size_t q = 0; q < nq; q++)
+            estimators[cell * nq + q].add(values[v]);
+    }
+}
+
+bool EnsembleStatistics::writeTable(const string& filename, const string& pointName,
+                                    const vector<double>& pointLabels,
+                                    const vector<string>& valueNames) const
+{
+    ofstream out(filename);
+    if (!out) {
+        cerr << "Error opening file: " << filename << "\n";
+        return false;
+    }
+    out << pointName;
+    for (auto &name : valueNames) {
+        out << "\t" << name << " mean\t" << name << " std";
+        for (double p : probabilities)
+            out << "\t" << name << " q" << lround(p * 100);
+    }
+    out << "\n";
+    for (size_t i = 0; i < nPoints; i++) {
+        out << (i < pointLabels.size() ? pointLabels[i] : static_cast<double>(i));
+        for (size_t v = 0; v < nValues; v++) {
+            const RunningStats& s = stats(i, v);
+            out << "\t" << s.mean << "\t" << sqrt(s.variance());
+            for (size_t q = 0; q < probabilities.size(); q++)
+                out << "\t" << quantile(i, v, q);
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+
+void runEnsemble(size_t replicas, size_t threads,
+                 EnsembleStatistics& grid, EnsembleStatistics& finals,
+                 const function<vector<double>(size_t, TrajectorySink&)>& run)
+{
+    ThreadPool pool(threads);
+    for (size_t r = 0; r < replicas; r++) {
+        pool.submit([&, r]() {
+            EnsembleGridSink sink(grid);
+            vector<double> result = run(r, sink);
+            if (result.size() >= finals.numValues())
+                finals.add(0, result.data());
+        });
+    }
+    pool.wait();
+}
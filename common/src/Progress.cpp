@@ -0,0 +1,81 @@
+#include "Progress.h"
+#include <algorithm>
+#include <climits>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+ProgressReporter::ProgressReporter(double total, const RunOptions& run, double intervalSeconds)
+    : style(run.verbose ? run.progress : ProgressStyle::Off),
+      callback(run.progressCallback),
+      total(total),
+      interval(intervalSeconds),
+      start(Clock::now()),
+      lastPoll(start),
+      lastReport(start)
+{
+    if (style == ProgressStyle::Callback && !callback)
+        style = ProgressStyle::Off;
+    if (style == ProgressStyle::Off)
+        countdown = LLONG_MAX;
+    else
+        report(0.0, start);
+}
+
+void ProgressReporter::poll(double progress)
+{
+    const Clock::time_point now = Clock::now();
+    const double sincePoll = chrono::duration<double>(now - lastPoll).count();
+    if (sincePoll < 5e-4 && stride < (1LL << 24))
+        stride *= 2;
+    else if (sincePoll > 5e-3 && stride > 1)
+        stride /= 2;
+    countdown = stride;
+    lastPoll = now;
+
+    if (chrono::duration<double>(now - lastReport).count() >= interval)
+        report(progress, now);
+}
+
+void ProgressReporter::report(double progress, Clock::time_point now)
+{
+    lastReport = now;
+    const double fraction = (total > 0.0) ? min(max(progress / total, 0.0), 1.0) : 1.0;
+    const double elapsed = chrono::duration<double>(now - start).count();
+    const double rate = (elapsed > 0.0) ? static_cast<double>(count) / elapsed : 0.0;
+    const double eta = (fraction > 0.0) ? elapsed * (1.0 - fraction) / fraction : -1.0;
+
+    if (style == ProgressStyle::Machine) {
+        // PROGRESS <fraction> <events> <events/s> <ETA s, -1 if unknown>
+        cerr << "PROGRESS " << fraction << " " << count << " " << rate << " " << eta << endl;
+        return;
+    }
+    if (style == ProgressStyle::Callback) {
+        callback(fraction, count, rate, eta);
+        return;
+    }
+
+    const int barWidth = 50;
+    const int filled = static_cast<int>(fraction * barWidth);
+    string bar(barWidth + 1, ' ');
+    for (int i = 0; i <= barWidth; i++)
+        bar[i] = (i < filled) ? '=' : (i == filled) ? '>' : ' ';
+    cout << "\r[" << bar << "] " << setw(3) << static_cast<int>(fraction * 100.0) << "% "
+         << setw(9) << setprecision(3) << rate << " events/s";
+    if (eta >= 0.0)
+        cout << "  ETA " << setw(7) << fixed << setprecision(1) << eta << " s" << defaultfloat;
+    cout << setprecision(6) << flush;
+}
+
+void ProgressReporter::finish(double progress)
+{
+    if (style == ProgressStyle::Off)
+        return;
+    report(progress, Clock::now());
+    if (style == ProgressStyle::Bar)
+        cout << "\n";
+    countdown = LLONG_MAX;
+    style = ProgressStyle::Off;
+}
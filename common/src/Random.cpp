@@ -0,0 +1,90 @@
+#include "Random.h"
+
+using namespace std;
+
+// Runtime dispatch between an AVX2 and a baseline build of the kernel.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PSR_SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define PSR_SIMD_CLONES
+#endif
+
+namespace {
+
+const uint32_t philoxM0 = 0xD2511F53u;
+const uint32_t philoxM1 = 0xCD9E8D57u;
+const uint32_t philoxW0 = 0x9E3779B9u;
+const uint32_t philoxW1 = 0xBB67AE85u;
+
+// Ten Philox rounds on the counter c0..c3 with key (k0, k1).
+inline void philoxRounds(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3,
+                         uint32_t k0, uint32_t k1)
+{
+    for (int round = 0; round < 10; round++) {
+        const uint64_t p0 = static_cast<uint64_t>(philoxM0) * c0;
+        const uint64_t p1 = static_cast<uint64_t>(philoxM1) * c2;
+        const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+        const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+        c1 = static_cast<uint32_t>(p1);
+        c3 = static_cast<uint32_t>(p0);
+        c0 = n0;
+        c2 = n2;
+        k0 += philoxW0;
+        k1 += philoxW1;
+    }
+}
+
+}
+
+PSR_SIMD_CLONES
+void philoxBlocks(const uint32_t key[2], uint32_t replica, uint32_t point,
+                  uint64_t first, size_t nBlocks, uint32_t* out)
+{
+    // Lanes of independent blocks in structure-of-arrays form; the round
+    // loop over them maps onto vector multiplies.
+    const size_t lanes = 8;
+    size_t b = 0;
+    for (; b + lanes <= nBlocks; b += lanes) {
+        uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            const uint64_t index = first + b + l;
+            c0[l] = static_cast<uint32_t>(index);
+            c1[l] = static_cast<uint32_t>(index >> 32);
+            c2[l] = replica;
+            c3[l] = point;
+        }
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < 10; round++) {
+            for (size_t l = 0; l < lanes; l++) {
+                const uint64_t p0 = static_cast<uint64_t>(philoxM0) * c0[l];
+                const uint64_t p1 = static_cast<uint64_t>(philoxM1) * c2[l];
+                const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+                const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+                c1[l] = static_cast<uint32_t>(p1);
+                c3[l] = static_cast<uint32_t>(p0);
+                c0[l] = n0;
+                c2[l] = n2;
+            }
+            k0 += philoxW0;
+            k1 += philoxW1;
+        }
+        for (size_t l = 0; l < lanes; l++) {
+            uint32_t* o = out + 4 * (b + l);
+            o[0] = c0[l];
+            o[1] = c1[l];
+            o[2] = c2[l];
+            o[3] = c3[l];
+        }
+    }
+    for (; b < nBlocks; b++) {
+        const uint64_t index = first + b;
+        uint32_t c0 = static_cast<uint32_t>(index), c1 = static_cast<uint32_t>(index >> 32);
+        uint32_t c2 = replica, c3 = point;
+        philoxRounds(c0, c1, c2, c3, key[0], key[1]);
+        uint32_t* o = out + 4 * b;
+        o[0] = c0;
+        o[1] = c1;
+        o[2] = c2;
+        o[3] = c3;
+    }
+}
@@ -0,0 +1,242 @@
+#include "RunReport.h"
+#include "Checkpoint.h"
+#include "TrajectoryWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char* const phaseNames[] = { "propensities", "selection", "update", "output", "statistics" };
+
+#if defined(__linux__)
+static int openCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // This thread, any CPU.
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+// Hardware counters read for the run, in JSON key order.
+static const char* const counterNames[] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+RunReport::RunReport(string engine, vector<string> reactions, bool enabled, size_t sampleEvery)
+    : engine(move(engine)),
+      reactions(move(reactions)),
+      counts(this->reactions.size(), 0.0),
+      sampleEvery(max<size_t>(sampleEvery, 1)),
+      countdown(numeric_limits<uint64_t>::max()),
+      start(Clock::now()),
+      mark(start)
+{
+    if (!enabled)
+        return;
+    countdown = nextGap();
+
+    const int reads = 256;
+    const Clock::time_point t0 = Clock::now();
+    Clock::time_point t1 = t0;
+    for (int i = 0; i < reads; i++)
+        t1 = Clock::now();
+    clockOverhead = chrono::duration<double>(t1 - t0).count() / reads;
+#if defined(__linux__)
+    const uint64_t configs[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    for (uint64_t config : configs) {
+        int fd = openCounter(PERF_TYPE_HARDWARE, config);
+        if (fd < 0) {
+            countersUnavailable = string("perf_event_open: ") + strerror(errno);
+            break;
+        }
+        counterFds.push_back(fd);
+    }
+    if (!countersUnavailable.empty()) {
+        for (int fd : counterFds)
+            close(fd);
+        counterFds.clear();
+    }
+    for (int fd : counterFds) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    countersUnavailable = "perf_event_open is Linux only";
+#endif
+    start = Clock::now();
+}
+
+RunReport::~RunReport()
+{
+#if defined(__linux__)
+    for (int fd : counterFds)
+        close(fd);
+#endif
+}
+
+void RunReport::saveTo(Checkpoint& checkpoint) const
+{
+    checkpoint.putDoubles("report.firings", counts);
+}
+
+bool RunReport::restoreFrom(const Checkpoint& checkpoint)
+{
+    vector<double> firings;
+    if (!checkpoint.getDoubles("report.firings", firings) || firings.size() != counts.size())
+        return false;
+    counts = firings;
+    return true;
+}
+
+void RunReport::set(const string& name, double value)
+{
+    for (auto& extra : extras) {
+        if (extra.first == name) {
+            extra.second = value;
+            return;
+        }
+    }
+    extras.emplace_back(name, value);
+}
+
+void RunReport::finish(double t)
+{
+    simulatedTime = t;
+    wallSeconds = chrono::duration<double>(Clock::now() - start).count();
+#if defined(__linux__)
+    for (size_t i = 0; i < counterFds.size(); i++) {
+        ioctl(counterFds[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t value = 0;
+        if (read(counterFds[i], &value, sizeof(value)) == static_cast<ssize_t>(sizeof(value)))
+            counterValues.emplace_back(counterNames[i], value);
+    }
+#endif
+}
+
+// JSON number; non-finite values become null.
+static void writeNumber(ostream& out, double value)
+{
+    if (std::isfinite(value))
+        out << value;
+    else
+        out << "null";
+}
+
+static void writeString(ostream& out, const string& s)
+{
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+bool RunReport::writeJson(const string& filename) const
+{
+    ofstream out(filename);
+    if (!out)
+        return false;
+    out.precision(10);
+
+    double events = 0.0;
+    for (double c : counts)
+        events += c;
+
+    out << "{\n  \"engine\": ";
+    writeString(out, engine);
+    out << ",\n  \"simulated_time\": ";
+    writeNumber(out, simulatedTime);
+    out << ",\n  \"wall_seconds\": ";
+    writeNumber(out, wallSeconds);
+    out << ",\n  \"steps\": " << steps;
+    out << ",\n  \"events\": ";
+    writeNumber(out, events);
+    out << ",\n  \"steps_per_second\": ";
+    writeNumber(out, wallSeconds > 0.0 ? static_cast<double>(steps) / wallSeconds : 0.0);
+    out << ",\n  \"events_per_second\": ";
+    writeNumber(out, wallSeconds > 0.0 ? events / wallSeconds : 0.0);
+
+    // The steps cost the untimed steps' time per step, split between the
+    // phases as the sampled times are; the rest of the wall time (set-up,
+    // closing the output, the clock reads themselves) is "other". With no
+    // untimed steps to go by, the sampled times are scaled up directly.
+    array<double, nPhases> measured {};
+    double measuredTotal = 0.0;
+    for (size_t p = 0; p < nPhases; p++) {
+        measured[p] = max(phaseSeconds[p] - clockOverhead * static_cast<double>(phaseMarks[p]), 0.0);
+        measuredTotal += measured[p];
+    }
+    double scale = 0.0;
+    if (untimedSteps > 0 && measuredTotal > 0.0)
+        scale = untimedSeconds / static_cast<double>(untimedSteps) * static_cast<double>(steps) / measuredTotal;
+    else if (sampledSteps > 0)
+        scale = static_cast<double>(steps) / static_cast<double>(sampledSteps);
+    double accounted = 0.0;
+    out << ",\n  \"phase_seconds\": {";
+    for (size_t p = 0; p < nPhases; p++) {
+        const double seconds = measured[p] * scale;
+        accounted += seconds;
+        out << (p ? ", " : " ") << '"' << phaseNames[p] << "\": ";
+        writeNumber(out, seconds);
+    }
+    out << ", \"other\": ";
+    writeNumber(out, wallSeconds - accounted);
+    out << " },\n  \"phase_sampling\": { \"every\": " << sampleEvery
+        << ", \"sampled_steps\": " << sampledSteps << ", \"untimed_steps\": " << untimedSteps << " }";
+
+    out << ",\n  \"reactions\": [";
+    for (size_t j = 0; j < reactions.size(); j++) {
+        out << (j ? ",\n" : "\n") << "    { \"index\": " << j + 1 << ", \"name\": ";
+        writeString(out, reactions[j]);
+        out << ", \"count\": ";
+        writeNumber(out, counts[j]);
+        out << ", \"fraction\": ";
+        writeNumber(out, events > 0.0 ? counts[j] / events : 0.0);
+        out << " }";
+    }
+    out << "\n  ]";
+
+    for (auto& extra : extras) {
+        out << ",\n  ";
+        writeString(out, extra.first);
+        out << ": ";
+        writeNumber(out, extra.second);
+    }
+
+    out << ",\n  \"hardware_counters\": ";
+    if (counterValues.empty()) {
+        out << "null,\n  \"hardware_counters_unavailable\": ";
+        writeString(out, countersUnavailable.empty() ? "not read" : countersUnavailable);
+    } else {
+        out << "{";
+        for (size_t i = 0; i < counterValues.size(); i++)
+            out << (i ? ", " : " ") << '"' << counterValues[i].first << "\": " << counterValues[i].second;
+        out << " }";
+    }
+    out << "\n}\n";
+    return static_cast<bool>(out);
+}
+
+string reportFilenameFor(const string& outputFilename)
+{
+    return filenameNextTo(outputFilename, ".report.json");
+}
@@ -0,0 +1,90 @@
+#include "Sampling.h"
+#include "Checkpoint.h"
+
+SamplingPolicy SamplingPolicy::fixedInterval(double dt)
+{
+    SamplingPolicy p;
+    p.mode = FixedInterval;
+    p.interval = dt;
+    return p;
+}
+
+SamplingPolicy SamplingPolicy::everyNEvents(long long n)
+{
+    SamplingPolicy p;
+    p.mode = EveryNEvents;
+    p.everyN = n > 0 ? n : 1;
+    return p;
+}
+
+SamplingPolicy SamplingPolicy::onChange(int species)
+{
+    SamplingPolicy p;
+    p.mode = OnChange;
+    p.species = species;
+    return p;
+}
+
+TrajectorySampler::TrajectorySampler(const SamplingPolicy& policy_)
+    : policy(policy_)
+{
+    // A non-positive grid spacing would never advance.
+    if (policy.mode == SamplingPolicy::FixedInterval && !(policy.interval > 0.0))
+        policy.mode = SamplingPolicy::EveryEvent;
+}
+
+bool TrajectorySampler::gridPointBefore(double tNext, double& tGrid)
+{
+    if (!fixedGrid())
+        return false;
+    // Grid times are k * dt rather than a running sum, so they do not drift.
+    double tg = static_cast<double>(gridIndex) * policy.interval;
+    if (tg >= tNext)
+        return false;
+    tGrid = tg;
+    gridIndex++;
+    return true;
+}
+
+bool TrajectorySampler::gridPointUpTo(double tEnd, double& tGrid)
+{
+    if (!fixedGrid())
+        return false;
+    double tg = static_cast<double>(gridIndex) * policy.interval;
+    // Tolerate round-off in k * dt so a grid point at tEnd itself is kept.
+    if (tg > tEnd + 1e-9 * policy.interval)
+        return false;
+    tGrid = tg;
+    gridIndex++;
+    return true;
+}
+
+bool TrajectorySampler::recordEvent(double before, double after)
+{
+    switch (policy.mode) {
+        case SamplingPolicy::EveryEvent:
+            return true;
+        case SamplingPolicy::EveryNEvents:
+            return ++eventCount % policy.everyN == 0;
+        case SamplingPolicy::OnChange:
+            return before != after;
+        default:
+            return false;
+    }
+}
+
+void TrajectorySampler::saveTo(Checkpoint& checkpoint) const
+{
+    checkpoint.putInteger("sampler.grid", static_cast<std::uint64_t>(gridIndex));
+    checkpoint.putInteger("sampler.events", static_cast<std::uint64_t>(eventCount));
+}
+
+bool TrajectorySampler::restoreFrom(const Checkpoint& checkpoint)
+{
+    std::uint64_t grid, events;
+    if (!checkpoint.getInteger("sampler.grid", grid) || !checkpoint.getInteger("sampler.events", events))
+        return false;
+    gridIndex = static_cast<long long>(grid);
+    eventCount = static_cast<long long>(events);
+    return true;
+}
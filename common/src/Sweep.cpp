@@ -0,0 +1,127 @@
+#include "Sweep.h"
+#include "ThreadPool.h"
+#include "Random.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+SweepAxis parseSweepAxis(const string& name, const string& spec)
+{
+    SweepAxis axis;
+    axis.name = name;
+    size_t c1 = spec.find(':');
+    if (c1 != string::npos) {
+        size_t c2 = spec.find(':', c1 + 1);
+        double lo = stod(spec.substr(0, c1));
+        double hi = stod(spec.substr(c1 + 1, c2 == string::npos ? string::npos : c2 - c1 - 1));
+        size_t n = (c2 == string::npos) ? 2 : stoul(spec.substr(c2 + 1));
+        if (n == 1) {
+            axis.values.push_back(lo);
+        } else {
+            for (size_t i = 0; i < n; i++)
+                axis.values.push_back(lo + (hi - lo) * static_cast<double>(i) / static_cast<double>(n - 1));
+        }
+        return axis;
+    }
+    stringstream ss(spec);
+    string item;
+    while (getline(ss, item, ','))
+        axis.values.push_back(stod(item));
+    return axis;
+}
+
+SweepDesign SweepDesign::grid(const vector<SweepAxis>& axes)
+{
+    SweepDesign design;
+    size_t total = 1;
+    for (auto &a : axes) {
+        design.names.push_back(a.name);
+        total *= a.values.size();
+    }
+    if (axes.empty())
+        return design;
+    design.points.reserve(total);
+    for (size_t i = 0; i < total; i++) {
+        vector<double> point;
+        size_t rest = i;
+        for (auto &a : axes) {
+            point.push_back(a.values[rest % a.values.size()]);
+            rest /= a.values.size();
+        }
+        design.points.push_back(point);
+    }
+    return design;
+}
+
+SweepDesign SweepDesign::latinHypercube(const vector<SweepRange>& ranges, size_t n, uint64_t seed)
+{
+    SweepDesign design;
+    design.points.assign(n, vector<double>(ranges.size()));
+    // Stream reserved for designs, apart from every simulation stream.
+    Rng gen(seed, 0xFFFFFFFFu, 0xFFFFFFFFu);
+    uniform_real_distribution<> dis(0.0, 1.0);
+    vector<size_t> strata(n);
+    for (size_t d = 0; d < ranges.size(); d++) {
+        design.names.push_back(ranges[d].name);
+        iota(strata.begin(), strata.end(), 0);
+        shuffle(strata.begin(), strata.end(), gen);
+        const double width = (ranges[d].hi - ranges[d].lo) / static_cast<double>(n);
+        for (size_t i = 0; i < n; i++)
+            design.points[i][d] = ranges[d].lo + (static_cast<double>(strata[i]) + dis(gen)) * width;
+    }
+    return design;
+}
+
+bool runSweep(const SweepDesign& design, size_t threads,
+              const string& tableFilename,
+              const vector<string>& resultNames,
+              const function<vector<double>(size_t, const vector<double>&)>& evaluate)
+{
+    ofstream out(tableFilename);
+    if (!out) {
+        cerr << "Error opening " << tableFilename << " for writing.\n";
+        return false;
+    }
+    // Write header line.
+    vector<string> columns = design.names;
+    columns.insert(columns.end(), resultNames.begin(), resultNames.end());
+    for (size_t i = 0; i < columns.size(); i++)
+        out << (i > 0 ? "\t" : "") << columns[i];
+    out << "\n" << flush;
+
+    const size_t nPoints = design.points.size();
+    vector<vector<double>> results(nPoints);
+    vector<bool> done(nPoints, false);
+    size_t nextRow = 0;
+    mutex tableMtx;
+
+    ThreadPool pool(threads);
+    for (size_t i = 0; i < nPoints; i++) {
+        pool.submit([&, i]() {
+            vector<double> result = evaluate(i, design.points[i]);
+            lock_guard<mutex> lock(tableMtx);
+            results[i] = move(result);
+            done[i] = true;
+            // Rows go out in design order: flush every completed leading point.
+            while (nextRow < nPoints && done[nextRow]) {
+                const vector<double>& point = design.points[nextRow];
+                for (size_t d = 0; d < point.size(); d++)
+                    out << (d > 0 ? "\t" : "") << point[d];
+                for (double v : results[nextRow])
+                    out << "\t" << v;
+                out << "\n";
+                results[nextRow].clear();
+                nextRow++;
+            }
+            out.flush();
+        });
+    }
+    pool.wait();
+    return true;
+}
@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (threads == 0)
+        threads = max<size_t>(1, thread::hardware_concurrency());
+    for (size_t i = 0; i < threads; i++)
+        queues.emplace_back(new Queue);
+    for (size_t i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(stateMtx);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto &w : workers)
+        w.join();
+}
+
+void ThreadPool::submit(function<void()> task)
+{
+    size_t target;
+    {
+        lock_guard<mutex> lock(stateMtx);
+        target = nextQueue;
+        nextQueue = (nextQueue + 1) % queues.size();
+        unfinished++;
+    }
+    {
+        lock_guard<mutex> lock(queues[target]->mtx);
+        queues[target]->tasks.push_back(move(task));
+    }
+    // Counted only once it is in a deque, so every claim below finds a task.
+    {
+        lock_guard<mutex> lock(stateMtx);
+        queued++;
+    }
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    unique_lock<mutex> lock(stateMtx);
+    allDone.wait(lock, [this] { return unfinished == 0; });
+}
+
+bool ThreadPool::popOrSteal(size_t self, function<void()>& task)
+{
+    {
+        Queue& own = *queues[self];
+        lock_guard<mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); k++) {
+        Queue& victim = *queues[(self + k) % queues.size()];
+        lock_guard<mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self)
+{
+    for (;;) {
+        {
+            unique_lock<mutex> lock(stateMtx);
+            workAvailable.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0 && stopping)
+                return;
+            queued--;
+        }
+        // The claimed task is in some deque, but the scan locks one deque at a
+        // time and can pass it while other claimers move things around.
+        function<void()> task;
+        while (!popOrSteal(self, task))
+            this_thread::yield();
+        task();
+        {
+            lock_guard<mutex> lock(stateMtx);
+            if (--unfinished == 0)
+                allDone.notify_all();
+        }
+    }
+}
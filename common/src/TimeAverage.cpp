@@ -0,0 +1,143 @@
+#include "TimeAverage.h"
+#include "Checkpoint.h"
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+TimeAverages::TimeAverages(size_t nChannels_, size_t maxBatches_)
+    : nChannels(nChannels_),
+      maxBatches(maxBatches_ < 2 * minBatches ? 2 * minBatches : maxBatches_ & ~static_cast<size_t>(1)),
+      integrals(maxBatches * nChannels, 0.0),
+      durations(maxBatches, 0.0),
+      partial(nChannels, 0.0)
+{
+}
+
+bool TimeAverages::add(const double* values, double dt)
+{
+    bool completed = false;
+    if (batchLength <= 0.0)
+        batchLength = 8.0 * dt;
+    while (dt > 0.0) {
+        const double room = batchLength - partialDuration;
+        const double step = (dt < room) ? dt : room;
+        for (size_t c = 0; c < nChannels; c++)
+            partial[c] += values[c] * step;
+        partialDuration += step;
+        dt -= step;
+        if (step == room) {
+            closeBatch();
+            completed = true;
+        }
+    }
+    return completed;
+}
+
+void TimeAverages::closeBatch()
+{
+    for (size_t c = 0; c < nChannels; c++) {
+        integrals[nBatches * nChannels + c] = partial[c];
+        partial[c] = 0.0;
+    }
+    durations[nBatches] = partialDuration;
+    partialDuration = 0.0;
+    nBatches++;
+
+    // Full: merge adjacent pairs and double the batch length.
+    if (nBatches == maxBatches) {
+        for (size_t b = 0; b < maxBatches / 2; b++) {
+            for (size_t c = 0; c < nChannels; c++)
+                integrals[b * nChannels + c] = integrals[2 * b * nChannels + c] + integrals[(2 * b + 1) * nChannels + c];
+            durations[b] = durations[2 * b] + durations[2 * b + 1];
+        }
+        nBatches = maxBatches / 2;
+        batchLength *= 2.0;
+    }
+}
+
+double TimeAverages::windowMean(size_t c, size_t first, size_t last) const
+{
+    double integral = 0.0, duration = 0.0;
+    for (size_t b = first; b < last; b++) {
+        integral += integrals[b * nChannels + c];
+        duration += durations[b];
+    }
+    return duration > 0.0 ? integral / duration : 0.0;
+}
+
+double TimeAverages::mean(size_t c) const
+{
+    return windowMean(c, nBatches / 2, nBatches);
+}
+
+double TimeAverages::halfWidth(size_t c, double z) const
+{
+    const size_t first = nBatches / 2;
+    const size_t n = nBatches - first;
+    if (n < minBatches)
+        return numeric_limits<double>::infinity();
+    double avg = 0.0;
+    for (size_t b = first; b < nBatches; b++)
+        avg += batchMean(c, b);
+    avg /= static_cast<double>(n);
+    double s2 = 0.0;
+    for (size_t b = first; b < nBatches; b++)
+        s2 += (batchMean(c, b) - avg) * (batchMean(c, b) - avg);
+    s2 /= static_cast<double>(n - 1);
+    return z * sqrt(s2 / static_cast<double>(n));
+}
+
+bool TimeAverages::stationary(size_t c, double z) const
+{
+    // Second quarter of the run against the last quarter: a drift over half
+    // the run shows up even when it is small within the window.
+    const size_t quarter = nBatches / 4;
+    if (2 * quarter < minBatches)
+        return false;
+    // Mean and squared standard error of the batch means in [from, to).
+    auto summary = [&](size_t from, size_t to, double& m, double& se2) {
+        const double n = static_cast<double>(to - from);
+        m = 0.0;
+        for (size_t b = from; b < to; b++)
+            m += batchMean(c, b);
+        m /= n;
+        double s2 = 0.0;
+        for (size_t b = from; b < to; b++)
+            s2 += (batchMean(c, b) - m) * (batchMean(c, b) - m);
+        se2 = s2 / (n - 1) / n;
+    };
+    double m1, se1, m2, se2;
+    summary(quarter, 2 * quarter, m1, se1);
+    summary(nBatches - quarter, nBatches, m2, se2);
+    return fabs(m1 - m2) <= z * sqrt(se1 + se2);
+}
+
+void TimeAverages::saveTo(Checkpoint& checkpoint, const string& name) const
+{
+    checkpoint.putInteger(name + ".batches", nBatches);
+    checkpoint.putDoubles(name + ".lengths", { batchLength, partialDuration });
+    checkpoint.putDoubles(name + ".integrals", integrals);
+    checkpoint.putDoubles(name + ".durations", durations);
+    checkpoint.putDoubles(name + ".partial", partial);
+}
+
+bool TimeAverages::restoreFrom(const Checkpoint& checkpoint, const string& name)
+{
+    uint64_t batches;
+    vector<double> lengths, savedIntegrals, savedDurations, savedPartial;
+    if (!checkpoint.getInteger(name + ".batches", batches) ||
+        !checkpoint.getDoubles(name + ".lengths", lengths) || lengths.size() != 2 ||
+        !checkpoint.getDoubles(name + ".integrals", savedIntegrals) || savedIntegrals.size() != integrals.size() ||
+        !checkpoint.getDoubles(name + ".durations", savedDurations) || savedDurations.size() != durations.size() ||
+        !checkpoint.getDoubles(name + ".partial", savedPartial) || savedPartial.size() != partial.size() ||
+        batches >= maxBatches)
+        return false;
+    nBatches = static_cast<size_t>(batches);
+    batchLength = lengths[0];
+    partialDuration = lengths[1];
+    integrals = savedIntegrals;
+    durations = savedDurations;
+    partial = savedPartial;
+    return true;
+}
@@ -0,0 +1,319 @@
+#include "TrajectoryWriter.h"
+#include "Checkpoint.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+using namespace std;
+
+static const char binaryMagic[8] = { 'P', 'S', 'R', 'T', 'R', 'J', '0', '1' };
+static const char indexMagic[8]  = { 'P', 'S', 'R', 'I', 'D', 'X', '0', '1' };
+static const uint32_t binaryVersion = 1;
+
+TrajectoryFormat trajectoryFormatFor(const string& filename)
+{
+    const string ext = ".ptraj";
+    if (filename.size() >= ext.size() &&
+        filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0)
+        return TrajectoryFormat::Binary;
+    return TrajectoryFormat::Text;
+}
+
+string filenameNextTo(const string& outputFilename, const string& suffix)
+{
+    const size_t slash = outputFilename.find_last_of("/\\");
+    const size_t dot = outputFilename.find_last_of('.');
+    const bool hasExtension = dot != string::npos && (slash == string::npos || dot > slash);
+    return (hasExtension ? outputFilename.substr(0, dot) : outputFilename) + suffix;
+}
+
+// Appends the raw bytes of a trivially copyable value.
+template <typename T>
+static void putRaw(vector<char>& buf, const T& value)
+{
+    const char* p = reinterpret_cast<const char*>(&value);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+static void putString(vector<char>& buf, const string& s)
+{
+    putRaw(buf, static_cast<uint16_t>(s.size()));
+    buf.insert(buf.end(), s.begin(), s.end());
+}
+
+static void putVarint(vector<char>& buf, uint64_t v)
+{
+    while (v >= 0x80) {
+        buf.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    buf.push_back(static_cast<char>(v));
+}
+
+TrajectoryWriter::TrajectoryWriter(const string& filename,
+                                   const TrajectoryHeader& header_,
+                                   TrajectoryFormat format_,
+                                   size_t rowsPerBuffer_)
+    : out(filename, ios::binary),
+      opened(static_cast<bool>(out)),
+      header(header_),
+      format(format_),
+      nColumns(header_.columns.size()),
+      rowsPerBuffer(rowsPerBuffer_ > 0 ? rowsPerBuffer_ : 1)
+{
+    if (!opened) {
+        cerr << "Error opening file: " << filename << "\n";
+        closed = true;
+        return;
+    }
+    if (format == TrajectoryFormat::Binary)
+        writeBinaryHeader();
+    else
+        writeTextHeader();
+    startIo();
+}
+
+TrajectoryWriter::TrajectoryWriter(const string& filename,
+                                   const TrajectoryHeader& header_,
+                                   const Checkpoint& checkpoint)
+    : opened(false),
+      header(header_),
+      format(trajectoryFormatFor(filename)),
+      nColumns(header_.columns.size()),
+      rowsPerBuffer(1)
+{
+    uint64_t bytes = 0, rows = 0, perBuffer = 0, binary = 0;
+    string index;
+    vector<double> buffered;
+    error_code ec;
+    const bool valid = checkpoint.getInteger("writer.bytes", bytes) &&
+                       checkpoint.getInteger("writer.rows", rows) &&
+                       checkpoint.getInteger("writer.rowsPerBuffer", perBuffer) &&
+                       checkpoint.getInteger("writer.binary", binary) &&
+                       checkpoint.getBytes("writer.blocks", index) &&
+                       checkpoint.getDoubles("writer.buffered", buffered) &&
+                       (binary != 0) == (format == TrajectoryFormat::Binary) &&
+                       perBuffer > 0 && nColumns > 0 &&
+                       buffered.size() % nColumns == 0 && buffered.size() / nColumns < perBuffer &&
+                       index.size() % sizeof(BlockIndex) == 0 &&
+                       filesystem::file_size(filename, ec) >= bytes && !ec;
+    if (valid) {
+        // Rows written after the checkpoint are written again by the resumed run.
+        filesystem::resize_file(filename, bytes, ec);
+        if (!ec)
+            out.open(filename, ios::binary | ios::app);
+    }
+    opened = valid && !ec && static_cast<bool>(out);
+    if (!opened) {
+        cerr << "Cannot resume " << filename << " from the checkpoint\n";
+        closed = true;
+        return;
+    }
+
+    bytesWritten = bytes;
+    rowsWritten = rows;
+    rowsPerBuffer = static_cast<size_t>(perBuffer);
+    blocks.resize(index.size() / sizeof(BlockIndex));
+    if (!blocks.empty())
+        memcpy(blocks.data(), index.data(), index.size());
+    startIo();
+    copy(buffered.begin(), buffered.end(), buffers[active].begin());
+    fill = buffered.size() / nColumns;
+}
+
+void TrajectoryWriter::startIo()
+{
+    buffers[0].resize(rowsPerBuffer * nColumns);
+    buffers[1].resize(rowsPerBuffer * nColumns);
+    // Worst case for a %g-style double is 13 characters plus the separator.
+    text.reserve(rowsPerBuffer * nColumns * 16);
+    io = thread(&TrajectoryWriter::ioLoop, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    close();
+}
+
+void TrajectoryWriter::writeRow(const double* values)
+{
+    if (!opened)
+        return;
+    double* row = nextRow();
+    for (size_t i = 0; i < nColumns; i++)
+        row[i] = values[i];
+    commitRow();
+}
+
+bool TrajectoryWriter::saveTo(Checkpoint& checkpoint)
+{
+    if (!opened || closed)
+        return false;
+    // With no buffer pending the I/O thread is idle and everything it wrote
+    // can be flushed to the file.
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [this] { return pending < 0; });
+    out.flush();
+    if (!out)
+        return false;
+    checkpoint.putInteger("writer.bytes", bytesWritten);
+    checkpoint.putInteger("writer.rows", rowsWritten);
+    checkpoint.putInteger("writer.rowsPerBuffer", rowsPerBuffer);
+    checkpoint.putInteger("writer.binary", format == TrajectoryFormat::Binary ? 1 : 0);
+    checkpoint.putBytes("writer.blocks", string(reinterpret_cast<const char*>(blocks.data()),
+                                                blocks.size() * sizeof(BlockIndex)));
+    const double* rows = buffers[active].data();
+    checkpoint.putDoubles("writer.buffered", vector<double>(rows, rows + fill * nColumns));
+    return true;
+}
+
+void TrajectoryWriter::swapBuffers()
+{
+    unique_lock<mutex> lock(mtx);
+    // Backpressure: wait only if the previous buffer is still being written.
+    cv.wait(lock, [this] { return pending < 0; });
+    pending = active;
+    pendingRows = fill;
+    active = 1 - active;
+    fill = 0;
+    lock.unlock();
+    cv.notify_all();
+}
+
+void TrajectoryWriter::close()
+{
+    if (closed)
+        return;
+    if (fill > 0)
+        swapBuffers();
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    io.join();
+    if (format == TrajectoryFormat::Binary)
+        writeBinaryIndex();
+    out.close();
+    closed = true;
+}
+
+void TrajectoryWriter::ioLoop()
+{
+    unique_lock<mutex> lock(mtx);
+    for (;;) {
+        cv.wait(lock, [this] { return pending >= 0 || stopping; });
+        if (pending < 0)
+            break;
+        int idx = pending;
+        size_t nRows = pendingRows;
+        lock.unlock();
+
+        if (format == TrajectoryFormat::Binary)
+            encodeBlock(buffers[idx], nRows);
+        else
+            formatRows(buffers[idx], nRows);
+        out.write(text.data(), static_cast<streamsize>(text.size()));
+        bytesWritten += text.size();
+
+        lock.lock();
+        pending = -1;
+        cv.notify_all();
+    }
+    out.flush();
+}
+
+void TrajectoryWriter::writeTextHeader()
+{
+    string line;
+    for (size_t i = 0; i < header.columns.size(); i++) {
+        if (i > 0)
+            line += '\t';
+        line += header.columns[i];
+    }
+    line += '\n';
+    out.write(line.data(), static_cast<streamsize>(line.size()));
+    bytesWritten += line.size();
+}
+
+void TrajectoryWriter::writeBinaryHeader()
+{
+    vector<char> buf(binaryMagic, binaryMagic + 8);
+    putRaw(buf, binaryVersion);
+    putRaw(buf, static_cast<uint32_t>(header.integerCounts ? 1 : 0));
+    putRaw(buf, static_cast<uint32_t>(header.nSpecies));
+    putRaw(buf, static_cast<uint32_t>(nColumns - 1 - header.nSpecies));
+    putRaw(buf, static_cast<uint32_t>(header.reactions.size()));
+    for (auto &c : header.columns)
+        putString(buf, c);
+    for (auto &r : header.reactions)
+        putString(buf, r);
+    out.write(buf.data(), static_cast<streamsize>(buf.size()));
+    bytesWritten += buf.size();
+}
+
+void TrajectoryWriter::writeBinaryIndex()
+{
+    vector<char> buf;
+    uint64_t indexOffset = bytesWritten;
+    for (auto &b : blocks) {
+        putRaw(buf, b.tFirst);
+        putRaw(buf, b.tLast);
+        putRaw(buf, b.offset);
+        putRaw(buf, b.firstRow);
+    }
+    putRaw(buf, static_cast<uint64_t>(blocks.size()));
+    putRaw(buf, indexOffset);
+    buf.insert(buf.end(), indexMagic, indexMagic + 8);
+    out.write(buf.data(), static_cast<streamsize>(buf.size()));
+    bytesWritten += buf.size();
+}
+
+// Formats rows with std::to_chars using 6 significant digits, which gives the
+// same text as the default ostream << double.
+void TrajectoryWriter::formatRows(const vector<double>& rows, size_t nRows)
+{
+    text.resize(nRows * nColumns * 16);
+    char* p = text.data();
+    for (size_t r = 0; r < nRows; r++) {
+        const double* row = &rows[r * nColumns];
+        for (size_t c = 0; c < nColumns; c++) {
+            if (c > 0)
+                *p++ = '\t';
+            p = to_chars(p, p + 15, row[c], chars_format::general, 6).ptr;
+        }
+        *p++ = '\n';
+    }
+    text.resize(static_cast<size_t>(p - text.data()));
+}
+
+// Transposes the buffered rows into one columnar block.
+void TrajectoryWriter::encodeBlock(const vector<double>& rows, size_t nRows)
+{
+    blocks.push_back({ rows[0], rows[(nRows - 1) * nColumns], bytesWritten, rowsWritten });
+    rowsWritten += nRows;
+
+    text.clear();
+    putRaw(text, static_cast<uint32_t>(nRows));
+    for (size_t c = 0; c < nColumns; c++) {
+        bool varint = header.integerCounts && c >= 1 && c <= header.nSpecies;
+        if (varint) {
+            size_t sizePos = text.size();
+            putRaw(text, static_cast<uint32_t>(0));
+            int64_t prev = 0;
+            for (size_t r = 0; r < nRows; r++) {
+                int64_t v = llround(rows[r * nColumns + c]);
+                int64_t d = v - prev;
+                prev = v;
+                putVarint(text, (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63));
+            }
+            uint32_t nBytes = static_cast<uint32_t>(text.size() - sizePos - sizeof(uint32_t));
+            memcpy(&text[sizePos], &nBytes, sizeof(nBytes));
+        } else {
+            for (size_t r = 0; r < nRows; r++)
+                putRaw(text, rows[r * nColumns + c]);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "RunOptions.h"
+#include "TrajectoryWriter.h"
+
+// Spatially resolved version of MonteCarloRecombinationReal: the Fv + Sv
+// surface sites lie on a periodic square lattice (W = ceil(sqrt(N)) columns,
+// the few sites left over in the last row are blocked), chemisorption sites
+// placed at random among the physisorption ones. Each site is one byte.
+//
+// Adsorption, desorption and Eley-Rideal events act on single sites, with the
+// rates of the well-mixed model per site. Diffusion onto a chemisorption site
+// (R5), the two Langmuir-Hinshelwood recombinations (R6, R7) and hops of Af
+// onto empty physisorption sites act on nearest-neighbour pairs only. Pair
+// rates are the mean-field ones times N / 4 per bond, so a randomly mixed
+// lattice has the well-mixed rates; Af hops at hopFactor * tau_d / 4 per
+// direction. Each bond's R5 then runs 0.75 N / hopFactor times faster than a
+// hop: with hopFactor = 1 an Af only reacts with the partners it finds next to
+// it (the diffusion-limited regime), and the gammas and coverages differ from
+// the well-mixed ones. The lattice approaches the well-mixed engine once
+// hopFactor is of the order of N / 10. Events are drawn rejection-free (n-fold
+// way) from eight classes of sites and bonds, each an array with O(1) insertion
+// and removal, and an event only re-classifies the sites and bonds around it.
+//
+// Rows have the columns of monteCarloRealHeader() (R5..R7 are the lattice
+// rates), and the result is laid out as MonteCarloRecombinationReal's, with
+// the gammas computed from the lattice rates.
+std::vector<double> LatticeRecombination(double initial_A, double initial_Fv,
+    double initial_Sv, double initial_A2, double M, double Tg, double Tw,
+    double k1, double k3, double k4, double vd,
+    double vD, double Ed, double ED, double Er, double ELHF,
+    double t_stop, TrajectorySink& sink,
+    const RunOptions& run = RunOptions(), double hopFactor = 1.0);
+
+// Same run, with the sampled rows written to outputFilename.
+std::vector<double> LatticeRecombination(double initial_A, double initial_Fv,
+    double initial_Sv, double initial_A2, double M, double Tg, double Tw,
+    double k1, double k3, double k4, double vd,
+    double vD, double Ed, double ED, double Er, double ELHF,
+    double t_stop, const std::string& outputFilename,
+    const RunOptions& run = RunOptions(), double hopFactor = 1.0);
@@ -2,9 +2,32 @@
 
 #include <string>
 #include <vector>
+#include "RunOptions.h"
+#include "TrajectoryWriter.h"
+
+// Runs the Monte Carlo simulation and returns
+//   { Tw, gamma_ER, gamma_LHS, gamma_LHF, gamma_total,
+//     95% half-widths of the four gammas, <Af>, <As>, time reached }.
+// The gammas and coverages are time averages over the later half of the run,
+// with batch-means confidence intervals. run.precision / run.stopAtSteadyState
+// end the run before t_stop once gamma_total has converged. run.checkpoint*
+// save checkpoints of the run and run.resumeFrom continues one (see
+// RunOptions); an empty vector means the checkpoint could not be resumed.
 
 std::vector<double> MonteCarloRecombinationReal(double initial_A, double initial_Fv,
     double initial_Sv, double initial_A2, double M, double Tg, double Tw,
     double k1, double k3, double k4, double vd,
     double vD, double Ed, double ED, double Er, double ELHF,
-    double t_stop, const std::string& outputFilename);
\ No newline at end of file
+    double t_stop, const std::string& outputFilename,
+    const RunOptions& run = RunOptions());
+
+// Same run, with the sampled rows sent to 'sink' instead of a file.
+std::vector<double> MonteCarloRecombinationReal(double initial_A, double initial_Fv,
+    double initial_Sv, double initial_A2, double M, double Tg, double Tw,
+    double k1, double k3, double k4, double vd,
+    double vD, double Ed, double ED, double Er, double ELHF,
+    double t_stop, TrajectorySink& sink,
+    const RunOptions& run = RunOptions());
+
+// Column layout of the rows written by MonteCarloRecombinationReal.
+TrajectoryHeader monteCarloRealHeader();
\ No newline at end of file
@@ -1,6 +1,24 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include "Sampling.h"
+#include "OdeSolvers.h"
+
+// Time integration used by RungeKuttaRecombination.
+enum class OdeMethod { RK4, DormandPrince45, Rosenbrock23 };
+
+struct OdeSettings {
+    // RK4 takes fixed steps of dt; the adaptive methods ignore dt and keep
+    // the local error within the tolerances. Rosenbrock23 is the stiff solver
+    // for long horizons.
+    OdeMethod method = OdeMethod::RK4;
+    OdeTolerances tolerances;
+    // Rate constants and solver statistics on the console.
+    bool verbose = true;
+    // Performance report (see RunReport) written here as JSON; empty: none.
+    std::string reportFilename;
+};
 
 void RungeKuttaRecombination(double A,  double Fv, double Af,
     double Sv, double As, double A2,
@@ -9,4 +27,39 @@ void RungeKuttaRecombination(double A,  double Fv, double Af,
     double k3, double k4, double Er, double ELHF,
     double vD, double ED,
     double dt, double tMax,
-    const std::string& outputFilename);
\ No newline at end of file
+    const std::string& outputFilename,
+    const SamplingPolicy& sampling = SamplingPolicy(),
+    const OdeSettings& ode = OdeSettings());
+
+// One classical RK4 step of dt of the 7-reaction model with rate constants
+// r1..r7, advancing the populations and t in place.
+void rk4Step6(double r1, double r2, double r3, double r4,
+    double r5, double r6, double r7,
+    double& A,  double& Fv, double& Af,
+    double& Sv, double& As, double& A2,
+    double& t,  double dt);
+
+// One parameter point of a batched integration. The initial populations are
+// A = O, Fv, Sv with Af = As = A2 = 0; M, k1, k3, k4, vd and vD are shared.
+struct RecombinationPoint {
+    double O, Fv, Sv;
+    double Tw, Tg, Ed, ED, Er, ELHF;
+};
+
+// State at tMax and the recombination probabilities it gives, defined as in
+// MonteCarloRecombinationReal.
+struct RecombinationResult {
+    double A, Fv, Af, Sv, As, A2;
+    double gamma_ER, gamma_LHS, gamma_LHF, gamma_total;
+};
+
+// RK4 with fixed steps of dt up to tMax for many parameter points at once.
+// The points are packed eight at a time in structure-of-arrays form and
+// stepped in lockstep, so each arithmetic operation advances a vector of
+// points (AVX2 / AVX-512 selected at run time, scalar fallback otherwise).
+// Same steps and result as RungeKuttaRecombination with OdeMethod::RK4.
+std::vector<RecombinationResult> RungeKuttaRecombinationBatch(
+    const std::vector<RecombinationPoint>& points,
+    double M, double k1, double vd,
+    double k3, double k4, double vD,
+    double dt, double tMax);
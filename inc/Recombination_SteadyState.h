@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+// Steady state of the surface populations of the 7-reaction model and the
+// recombination probabilities it gives (defined as in MonteCarloRecombinationReal).
+struct SteadyState {
+    double Af = 0.0;
+    double As = 0.0;
+    double gamma_ER = 0.0;
+    double gamma_LHS = 0.0;
+    double gamma_LHF = 0.0;
+    double gamma_total = 0.0;
+    // Both eigenvalues of the balance Jacobian have negative real parts.
+    bool stable = false;
+};
+
+// Solves the mean-field balance dAf/dt = dAs/dt = 0 directly. The gas phase
+// is a reservoir held at A = O, and the site totals Fv + Af = Fv0 and
+// Sv + As = Sv0 are conserved, which leaves two unknowns. Damped Newton
+// iterations with the analytic Jacobian are started from a grid over the
+// physical domain, so every steady state found is returned (sorted by Af) with
+// its stability. More than one state, or none stable, means the time
+// evolution depends on the initial coverage.
+std::vector<SteadyState> SteadyStateRecombination(double O, double Fv0, double Sv0,
+    double M, double Tg, double Tw,
+    double k1, double vd, double Ed,
+    double k3, double k4, double Er, double ELHF,
+    double vD, double ED);
@@ -1,33 +1,127 @@
 #pragma once
 
 #include <vector>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 #include <map>
 #include <string>
+#include "RunOptions.h"
+#include "TrajectoryWriter.h"
+#include "OdeSolvers.h"
 
-auto prop_single = [](int idx) {
-    return [=](const std::vector<double>& state, double k) -> double {
-        return k * state[idx];
-    };
+// Structure for a reaction event with a mass-action propensity
+// k * x[reactant1] (first order) or k * x[reactant1] * x[reactant2].
+struct ReactionEvent {
+    int order = 1;
+    int reactant1 = 0;
+    int reactant2 = 0;
+    double k = 0.0;
+    // Sparse stoichiometry: (species index, change) for the touched species only.
+    std::vector<std::pair<int, int>> stoich;
 };
 
-auto prop_bimolecular = [](int idx1, int idx2) {
-    return [=](const std::vector<double>& state, double k) -> double {
-        return k * state[idx1] * state[idx2];
-    };
-};
+// Propensity k * x[idx].
+inline ReactionEvent prop_single(int idx)
+{
+    ReactionEvent e;
+    e.order = 1;
+    e.reactant1 = e.reactant2 = idx;
+    return e;
+}
+
+// Propensity k * x[idx1] * x[idx2].
+inline ReactionEvent prop_bimolecular(int idx1, int idx2)
+{
+    ReactionEvent e;
+    e.order = 2;
+    e.reactant1 = idx1;
+    e.reactant2 = idx2;
+    return e;
+}
+
+// Propensity k * x[idx]^2.
+inline ReactionEvent prop_square(int idx)
+{
+    return prop_bimolecular(idx, idx);
+}
+
+// Reaction network compiled to structure-of-arrays form for the SSA loops.
+// Propensities are evaluated on a padded state x of nSpecies + 1 entries whose
+// last entry is fixed at 1. First-order reactions use that entry as their
+// second reactant, so every propensity is k * x[r1] * x[r2] without indirect
+// calls.
+//
+// The stochastic engines hold the populations as exact 64-bit counts n, with
+// x as their double copy. A propensity is zero unless the reaction's
+// reactants are present (x >= 2 for the square reactions), so firing a
+// reaction never drives a count negative and needs no clamping.
+struct ReactionTable {
+    std::size_t nSpecies = 0;
+    std::size_t nReactions = 0;
+    std::vector<int> order;
+    std::vector<int> reactant1;
+    std::vector<int> reactant2;
+    std::vector<double> k;
+    // Stoichiometry in CSR form: reaction j touches entries [stoichStart[j], stoichStart[j + 1]).
+    std::vector<int> stoichStart;
+    std::vector<int> stoichSpecies;
+    std::vector<std::int64_t> stoichChange;
+    // Smallest x[reactant1] at which reaction j can fire: 2 for the square
+    // reactions, 0 for the others (their product already vanishes), -inf for
+    // continuous populations.
+    std::vector<double> minReactant;
+
+    double propensity(const double* x, std::size_t j) const
+    {
+        return x[reactant1[j]] >= minReactant[j] ? k[j] * x[reactant1[j]] * x[reactant2[j]] : 0.0;
+    }
+
+    // Fills a[0..nReactions) and returns the total rate.
+    double propensities(const double* x, double* a) const
+    {
+        const double* kp = k.data();
+        const int* r1 = reactant1.data();
+        const int* r2 = reactant2.data();
+        const double* least = minReactant.data();
+        double total = 0.0;
+        for (std::size_t j = 0; j < nReactions; j++) {
+            a[j] = x[r1[j]] >= least[j] ? kp[j] * x[r1[j]] * x[r2[j]] : 0.0;
+            total += a[j];
+        }
+        return total;
+    }
 
-auto prop_square = [](int idx) {
-    return [=](const std::vector<double>& state, double k) -> double {
-        return k * state[idx] * state[idx];
-    };
+    // Applies reaction j to the counts n and their copy x, touching only the
+    // species in its stoichiometry. Reaction j must have a positive propensity.
+    void fire(std::int64_t* n, double* x, std::size_t j) const
+    {
+        for (int e = stoichStart[j]; e < stoichStart[j + 1]; e++) {
+            const int s = stoichSpecies[e];
+            n[s] += stoichChange[e];
+            x[s] = static_cast<double>(n[s]);
+        }
+    }
 };
 
-// Structure for a reaction event.
-struct ReactionEvent {
-    std::function<double(const std::vector<double>&, double)> propensity;
-    std::vector<double> delta;
-    double k;
+// Whole-molecule counts of a state (rounded to the nearest integer, negative
+// entries to zero), as the stochastic engines start from.
+std::vector<std::int64_t> wholeCounts(const std::vector<double>& state);
+
+// Padded double copy x of counts n (see ReactionTable).
+std::vector<double> paddedState(const std::vector<std::int64_t>& n);
+
+// Reaction selection backend of the direct method (see ReactionSelection.h).
+enum class SelectionMethod { Linear, SumTree, CompositionRejection };
+
+// Run settings shared by the engines (sampling, random stream and verbosity
+// come from RunOptions).
+struct SimulationOptions : RunOptions {
+    SelectionMethod selection = SelectionMethod::Linear;
+    // Tau-leaping: bound on the expected relative change of any reactant per leap.
+    double tauEpsilon = 0.03;
+    // Mean-field engine: error control of the ODE solver.
+    OdeTolerances odeTolerances;
 };
 
 // Function declarations
@@ -42,14 +136,138 @@ std::vector<ReactionEvent> buildEventsForReaction(const std::string& reaction,
     bool chemPresent,
     bool surfPresent);
 
-// Prints a progress bar to the terminal that updates in-place.
-// 'progress' is the current progress, 'total' is the total value (e.g. simulation stop time).
-void printProgressBar(double progress, double total);
+// Network given on the engine's command line: the reaction names, then the
+// rate parameters, the initial populations of the species union and t_stop.
+struct ReactionNetwork {
+    std::vector<std::string> reactions;
+    // Species union in the fixed order A, B, Af, As, Fv, Sv, A2.
+    std::vector<std::string> species;
+    std::map<std::string, int> speciesIndex;
+    std::vector<ReactionEvent> events;
+    std::vector<double> initialState;
+    double t_stop = 0.0;
+};
+
+// Parses the positional arguments into a network, setting the global
+// parameters buildEventsForReaction reads, so it can be called again for
+// another network. Returns false with a message in 'error' on bad input.
+bool parseReactionNetwork(const std::vector<std::string>& args, ReactionNetwork& network,
+                          std::string& error);
 
-// Runs the Gillespie simulation until t_stop and writes a full trajectory to outputFilename.
+// Flattens the events into a ReactionTable over nSpecies populations. With
+// integerCounts false (continuous populations of the mean-field engine) no
+// reaction has a minimum reactant count.
+ReactionTable compileReactionTable(const std::vector<ReactionEvent>& events, std::size_t nSpecies,
+                                   bool integerCounts = true);
+
+// Writes a reaction as text from its stoichiometry, e.g. "2 Af -> A2 + 2 Fv".
+std::string describeReaction(const ReactionEvent& event, const std::vector<std::string>& speciesList);
+
+// Header of the trajectories written by the engines: Time, "Population <s>"
+// per species, then one R<j> propensity column per event.
+TrajectoryHeader trajectoryHeaderFor(const std::vector<ReactionEvent>& events,
+                                     const std::vector<std::string>& speciesList);
+
+// Runs the Gillespie simulation until t_stop, streaming the trajectory to outputFilename
+// through a TrajectoryWriter so memory use does not grow with the event count.
+// A ".ptraj" filename selects the binary trajectory format; options.sampling
+// selects which states are written and options.selection how the firing
+// reaction is picked. The TrajectorySink overload sends the rows elsewhere
+// (e.g. to an ensemble accumulator).
+void simulateMultiReaction(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    const std::vector<std::string>& speciesList,
+    const std::string& outputFilename,
+    const SimulationOptions& options = SimulationOptions());
 void simulateMultiReaction(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    TrajectorySink& sink,
+    const SimulationOptions& options = SimulationOptions());
+
+// Reactions whose propensity may change when each reaction fires (including itself).
+std::vector<std::vector<int>> buildDependencyGraph(const ReactionTable& table);
+
+// Same interface and output as simulateMultiReaction, using the Gibson-Bruck
+// Next Reaction Method: putative firing times in an indexed priority queue and
+// incremental propensity updates through the dependency graph.
+void simulateNextReaction(
     double t_stop,
     const std::vector<ReactionEvent>& events,
     std::vector<double>& state,
     const std::vector<std::string>& speciesList,
-    const std::string& outputFilename);
\ No newline at end of file
+    const std::string& outputFilename,
+    const SimulationOptions& options = SimulationOptions());
+void simulateNextReaction(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    TrajectorySink& sink,
+    const SimulationOptions& options = SimulationOptions());
+
+// Same interface and output as simulateMultiReaction, using adaptive explicit
+// tau-leaping (Cao-Gillespie step selection, exact firing of critical
+// reactions and SSA fallback for short leaps). options.tauEpsilon sets the
+// accuracy; runtime follows the simulated time rather than the event count.
+void simulateTauLeaping(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    const std::vector<std::string>& speciesList,
+    const std::string& outputFilename,
+    const SimulationOptions& options = SimulationOptions());
+void simulateTauLeaping(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    TrajectorySink& sink,
+    const SimulationOptions& options = SimulationOptions());
+
+// Deterministic counterpart of the engines above: the mass-action rate
+// equations of the same network, compiled into flat right-hand-side and
+// Jacobian term lists and solved with the stiff Rosenbrock 2(3) integrator
+// (options.odeTolerances). Populations become continuous mean values; the
+// output layout is unchanged, with one row per accepted step or on the
+// options.sampling grid (interpolated from the dense output).
+void simulateMeanField(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    const std::vector<std::string>& speciesList,
+    const std::string& outputFilename,
+    const SimulationOptions& options = SimulationOptions());
+void simulateMeanField(
+    double t_stop,
+    const std::vector<ReactionEvent>& events,
+    std::vector<double>& state,
+    TrajectorySink& sink,
+    const SimulationOptions& options = SimulationOptions());
+
+// Signature shared by the engines above.
+using EngineFunction = void (*)(double, const std::vector<ReactionEvent>&, std::vector<double>&,
+                                TrajectorySink&, const SimulationOptions&);
+
+// Engine for --engine=direct, nrm, tau or ode; nullptr for an unknown name.
+EngineFunction engineByName(const std::string& name);
+
+// Reads the run options shared by the command line and the server:
+// --sample-dt / --sample-every / --sample-on, --selector, --tau-eps, --rtol
+// and --atol. Returns false with a message in 'error' on bad input.
+bool parseSimulationOptions(const std::map<std::string, std::string>& options,
+                            const ReactionNetwork& network, SimulationOptions& simOptions,
+                            std::string& error);
+
+// Simulation server (see Server.cpp): runs the jobs sent as length-prefixed
+// requests on stdin, or on a Unix socket when socketPath is not empty, and
+// streams the trajectories back. Returns the exit status.
+int runServer(const std::string& socketPath);
+
+// Batch mode (see Manifest.cpp): runs every job of a manifest file, one
+// command line per line, serving the jobs already computed from the result
+// cache. options: --cache=<dir>, --no-cache, --threads=<n>, --seed=<n> and
+// the console options. Returns the exit status.
+int runManifest(const std::string& manifestFilename,
+                const std::map<std::string, std::string>& options);
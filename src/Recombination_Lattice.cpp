@@ -0,0 +1,499 @@
+#include "Recombination_Lattice.h"
+#include "Recombination_MC_real.h"
+#include "Sampling.h"
+#include "Random.h"
+#include "TimeAverage.h"
+#include "Progress.h"
+#include "RunReport.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#ifndef pi
+#define pi 3.14159265358979323846
+#endif
+
+using namespace std;
+
+namespace {
+
+// State of a site, which is also its event class (blocked sites have none).
+enum SiteState : std::uint8_t { EmptyF, OccupiedF, EmptyS, OccupiedS, Blocked };
+const int nSiteClasses = 4;
+
+// Site byte: the state in the low bits, plus flags for the first and last
+// column, so that neighbours are found without a division.
+const std::uint8_t stateBits = 0x07;
+const std::uint8_t firstColumn = 0x08;
+const std::uint8_t lastColumn = 0x10;
+
+// Event classes of the bonds between nearest neighbours: Af next to an empty
+// chemisorption site (R5), to As (R6), to Af (R7), to an empty
+// physisorption site (hop). Other bonds have no event.
+enum BondClass { Trap, RecombineS, RecombineF, Hop, NoEvent };
+const int nBondClasses = 4;
+
+const std::uint32_t absent = std::numeric_limits<std::uint32_t>::max();
+
+// Bond class from the states of its two sites.
+const std::uint8_t bondClassOf[5][5] = {
+    //           EmptyF   OccupiedF   EmptyS   OccupiedS   Blocked
+    /* EmptyF */ { NoEvent, Hop,       NoEvent, NoEvent,    NoEvent },
+    /* Occ. F */ { Hop,     RecombineF, Trap,   RecombineS, NoEvent },
+    /* EmptyS */ { NoEvent, Trap,      NoEvent, NoEvent,    NoEvent },
+    /* Occ. S */ { NoEvent, RecombineS, NoEvent, NoEvent,   NoEvent },
+    /* Blocked*/ { NoEvent, NoEvent,   NoEvent, NoEvent,    NoEvent },
+};
+
+// Periodic W x H lattice of site bytes with the catalogue of events: one
+// array of members per site class and per bond class, and the position of
+// every site and bond in its array, so that moving one between classes is
+// O(1). Bond 2 s joins site s to its right neighbour, bond 2 s + 1 to the
+// one below; the positions of site s and of its two bonds share a record,
+// so an event touches few cache lines.
+class SurfaceLattice {
+public:
+    SurfaceLattice(std::uint32_t nF, std::uint32_t nS, Rng& gen)
+    {
+        const std::uint32_t n = nF + nS;
+        width = static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+        height = (n + width - 1) / width;
+        nSites = width * height;
+        site.assign(nSites, Blocked);
+        pos.assign(nSites, Positions());
+
+        // The minority kind is scattered at random over the majority one.
+        const bool fewerS = nS <= nF;
+        std::fill(site.begin(), site.begin() + n, fewerS ? EmptyF : EmptyS);
+        for (std::uint32_t placed = 0; placed < (fewerS ? nS : nF); ) {
+            std::uint32_t s = static_cast<std::uint32_t>(gen.uniform() * n);
+            if (s >= n)
+                s = n - 1;
+            if (site[s] == (fewerS ? EmptyF : EmptyS)) {
+                site[s] = fewerS ? EmptyS : EmptyF;
+                placed++;
+            }
+        }
+        for (std::uint32_t s = 0; s < nSites; s += width) {
+            site[s] |= firstColumn;
+            site[s + width - 1] |= lastColumn;
+        }
+        // Every site starts empty, so no bond has an event yet.
+        sites[EmptyF].reserve(nF);
+        sites[EmptyS].reserve(nS);
+        for (std::uint32_t s = 0; s < n; s++)
+            insertSite(at(s), s);
+    }
+
+    std::size_t siteCount(int c) const { return sites[c].size(); }
+    std::size_t bondCount(int c) const { return bonds[c].size(); }
+
+    // Uniform member of a non-empty class, for u in [0, 1).
+    std::uint32_t pickSite(int c, double u) const { return pick(sites[c], u); }
+    std::uint32_t pickBond(int c, double u) const { return pick(bonds[c], u); }
+
+    SiteState at(std::uint32_t s) const { return static_cast<SiteState>(site[s] & stateBits); }
+
+    // The two sites of bond b.
+    void ends(std::uint32_t b, std::uint32_t& s, std::uint32_t& t) const
+    {
+        s = b / 2;
+        t = (b % 2 == 0) ? right(s) : down(s);
+    }
+
+    void set(std::uint32_t s, SiteState value)
+    {
+        const SiteState old = at(s);
+        moveSite(s, old, value);
+        std::uint32_t b[4], other[4];
+        bondsOf(s, b, other);
+        for (int i = 0; i < 4; i++) {
+            const SiteState o = at(other[i]);
+            moveBond(b[i], bondClassOf[old][o], bondClassOf[value][o]);
+        }
+    }
+
+    // Changes two neighbouring sites at once.
+    void set(std::uint32_t s, SiteState sValue, std::uint32_t t, SiteState tValue)
+    {
+        const SiteState sOld = at(s), tOld = at(t);
+        moveSite(s, sOld, sValue);
+        moveSite(t, tOld, tValue);
+        auto before = [&](std::uint32_t u) { return u == s ? sOld : u == t ? tOld : at(u); };
+        std::uint32_t b[4], other[4];
+        bondsOf(s, b, other);
+        for (int i = 0; i < 4; i++)
+            moveBond(b[i], bondClassOf[sOld][before(other[i])], bondClassOf[sValue][at(other[i])]);
+        // The bonds between s and t have been moved with s.
+        bondsOf(t, b, other);
+        for (int i = 0; i < 4; i++) {
+            if (other[i] != s)
+                moveBond(b[i], bondClassOf[tOld][at(other[i])], bondClassOf[tValue][at(other[i])]);
+        }
+    }
+
+private:
+    static std::uint32_t pick(const std::vector<std::uint32_t>& members, double u)
+    {
+        std::size_t k = static_cast<std::size_t>(u * static_cast<double>(members.size()));
+        return members[std::min(k, members.size() - 1)];
+    }
+
+    std::uint32_t right(std::uint32_t s) const { return (site[s] & lastColumn) ? s + 1 - width : s + 1; }
+    std::uint32_t left(std::uint32_t s) const { return (site[s] & firstColumn) ? s + width - 1 : s - 1; }
+    std::uint32_t down(std::uint32_t s) const { return (s + width < nSites) ? s + width : s + width - nSites; }
+    std::uint32_t up(std::uint32_t s) const { return (s >= width) ? s - width : s + nSites - width; }
+
+    // The four bonds of site s and the sites at their other ends.
+    void bondsOf(std::uint32_t s, std::uint32_t b[4], std::uint32_t other[4]) const
+    {
+        other[0] = right(s);
+        other[1] = down(s);
+        other[2] = left(s);
+        other[3] = up(s);
+        b[0] = 2 * s;
+        b[1] = 2 * s + 1;
+        b[2] = 2 * other[2];
+        b[3] = 2 * other[3] + 1;
+    }
+
+    std::uint32_t& sitePos(std::uint32_t s) { return pos[s].site; }
+    std::uint32_t& bondPos(std::uint32_t b) { return pos[b / 2].bond[b % 2]; }
+
+    void insertSite(int c, std::uint32_t s)
+    {
+        sitePos(s) = static_cast<std::uint32_t>(sites[c].size());
+        sites[c].push_back(s);
+    }
+
+    void moveSite(std::uint32_t s, SiteState from, SiteState to)
+    {
+        std::vector<std::uint32_t>& members = sites[from];
+        const std::uint32_t last = members.back();
+        members[sitePos(s)] = last;
+        sitePos(last) = sitePos(s);
+        members.pop_back();
+        insertSite(to, s);
+        site[s] = static_cast<std::uint8_t>((site[s] & ~stateBits) | to);
+    }
+
+    // Only bonds whose class changes touch the catalogue.
+    void moveBond(std::uint32_t b, std::uint8_t from, std::uint8_t to)
+    {
+        if (from == to)
+            return;
+        if (from != NoEvent) {
+            std::vector<std::uint32_t>& members = bonds[from];
+            const std::uint32_t last = members.back();
+            members[bondPos(b)] = last;
+            bondPos(last) = bondPos(b);
+            members.pop_back();
+        }
+        if (to != NoEvent) {
+            bondPos(b) = static_cast<std::uint32_t>(bonds[to].size());
+            bonds[to].push_back(b);
+        }
+    }
+
+    // Position of a site in its class and of its two bonds in theirs.
+    struct Positions {
+        std::uint32_t site = absent;
+        std::uint32_t bond[2] = { absent, absent };
+    };
+
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::uint32_t nSites = 0;
+    std::vector<std::uint8_t> site;
+    std::vector<Positions> pos;
+    std::vector<std::uint32_t> sites[nSiteClasses];
+    std::vector<std::uint32_t> bonds[nBondClasses];
+};
+
+}
+
+std::vector<double> LatticeRecombination(double initial_A, double initial_Fv,
+    double initial_Sv, double initial_A2, double M, double Tg, double Tw,
+    double k1, double k3, double k4, double vd,
+    double vD, double Ed, double ED, double Er, double ELHF,
+    double t_stop, const std::string& outputFilename,
+    const RunOptions& run, double hopFactor)
+{
+    TrajectoryWriter writer(outputFilename, monteCarloRealHeader());
+    std::vector<double> gammas = LatticeRecombination(initial_A, initial_Fv,
+        initial_Sv, initial_A2, M, Tg, Tw, k1, k3, k4, vd, vD, Ed, ED, Er, ELHF,
+        t_stop, static_cast<TrajectorySink&>(writer), run, hopFactor);
+    writer.close();
+    return gammas;
+}
+
+std::vector<double> LatticeRecombination(double initial_A, double initial_Fv,
+    double initial_Sv, double initial_A2, double M, double Tg, double Tw,
+    double k1, double k3, double k4, double vd,
+    double vD, double Ed, double ED, double Er, double ELHF,
+    double t_stop, TrajectorySink& sink,
+    const RunOptions& run, double hopFactor)
+{
+    const double nF = std::round(initial_Fv);
+    const double nS = std::round(initial_Sv);
+    // At least 2 x 2 sites, so that no site is its own neighbour.
+    if (nF < 0 || nS < 0 || nF + nS < 3 || nF + nS > 1e9) {
+        std::cerr << "The lattice needs between 3 and 1e9 sites (Fv + Sv).\n";
+        return {};
+    }
+    if (!(hopFactor > 0.0)) {
+        std::cerr << "The hop rate factor must be positive.\n";
+        return {};
+    }
+
+    double kb = 1.380649e-23;
+    double Na = 6.023e23;
+
+    double v_med = std::sqrt((8*kb*Tg*Na)/(pi * M));
+
+    double phi_O = 0.25 * v_med * initial_A;
+    double Pr = k4 * std::exp(-Er/(Na*kb*Tw));
+    double Prlh = k4 * std::exp(-ELHF/(Na*kb*Tw));
+    double tau_d_1 = vD * std::exp(-ED/(Na*kb*Tw));
+
+    // Rate coefficients of the well-mixed model.
+    double r1 = k1 * phi_O;
+    double r2 = vd * std::exp(-Ed/(Na*kb*Tw));
+    double r3 = k3 * phi_O;
+    double r4 = Pr * r3;
+    double r5 = 0.75*tau_d_1;
+    double r6 = tau_d_1 * Pr;
+    double r7 = tau_d_1 * Prlh;
+
+    // Per bond: a random lattice has Af * 4 Sv / N bonds Af-Sv (likewise
+    // Af-As) and 2 Af^2 / N bonds Af-Af.
+    const double N = nF + nS;
+    const double k5 = r5 * N / 4.0;
+    const double k6 = r6 * N / 4.0;
+    const double k7 = r7 * N / 2.0;
+    const double kHop = hopFactor * tau_d_1 / 4.0;
+
+    // Exact gas-phase counts (the surface is counted by the lattice classes).
+    double t = 0.0;
+    std::int64_t A = static_cast<std::int64_t>(std::llround(std::max(initial_A, 0.0)));
+    std::int64_t A2 = static_cast<std::int64_t>(std::llround(std::max(initial_A2, 0.0)));
+
+    const double S = nS;
+    const double F = nF;
+
+    Rng gen = makeGenerator(run);
+    SurfaceLattice lattice(static_cast<std::uint32_t>(nF), static_cast<std::uint32_t>(nS), gen);
+
+    const SamplingPolicy& sampling = run.sampling;
+    TrajectorySampler sampler(sampling);
+
+    // Populations in column order (A, Fv, Af, Sv, As, A2), for the OnChange
+    // watched species.
+    auto population = [&](int i) {
+        switch (i) {
+            case 0: return static_cast<double>(A);
+            case 1: return static_cast<double>(lattice.siteCount(EmptyF));
+            case 2: return static_cast<double>(lattice.siteCount(OccupiedF));
+            case 3: return static_cast<double>(lattice.siteCount(EmptyS));
+            case 4: return static_cast<double>(lattice.siteCount(OccupiedS));
+            default: return static_cast<double>(A2);
+        }
+    };
+    const int watched = (sampling.species >= 0 && sampling.species < 6) ? sampling.species : 0;
+
+    // Class rates: R1..R7, then the hops.
+    double R[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    auto computeRates = [&]() {
+        R[0] = r1 * population(0) * population(1);     // A + Fv -> Af
+        R[1] = r2 * population(2);                      // Af -> A + Fv
+        R[2] = r3 * population(0) * population(3);     // A + Sv -> As
+        R[3] = r4 * population(0) * population(4);     // A + As -> A2 + Sv
+        R[4] = k5 * static_cast<double>(lattice.bondCount(Trap));            // Af + Sv -> Fv + As
+        R[5] = k6 * static_cast<double>(lattice.bondCount(RecombineS));      // Af + As -> A2 + Sv + Fv
+        R[6] = k7 * static_cast<double>(lattice.bondCount(RecombineF));      // Af + Af -> A2 + 2 Fv
+        R[7] = kHop * static_cast<double>(lattice.bondCount(Hop));           // Af + Fv -> Fv + Af
+    };
+    auto record = [&](double time) {
+        const double row[] = { time, population(0), population(1), population(2),
+                               population(3), population(4), population(5),
+                               R[0], R[1], R[2], R[3], R[4], R[5], R[6] };
+        sink.writeRow(row);
+    };
+
+    // Time-weighted accumulators, as in MonteCarloRecombinationReal, with
+    // the lattice's LH rates in place of the mean-field products.
+    TimeAverages averages(6);
+    double held[6];
+    auto currentValues = [&]() {
+        const double As = population(4);
+        held[0] = population(2);
+        held[1] = As;
+        held[2] = 2 * r4 * As * S / (phi_O * (S + F));
+        held[3] = 2 * R[5] * S / (phi_O * (S + F));
+        held[4] = 2 * R[6] * F / (phi_O * (S + F));
+        held[5] = held[2] + held[3] + held[4];
+    };
+    const bool mayStop = run.precision > 0.0 || run.stopAtSteadyState;
+    double stationarySince = -1.0;
+    auto converged = [&](double now) {
+        if (!averages.stationary(5)) {
+            stationarySince = -1.0;
+            return false;
+        }
+        if (stationarySince < 0.0)
+            stationarySince = now;
+        if (now < 2.0 * stationarySince)
+            return false;
+        return run.stopAtSteadyState
+            || averages.halfWidth(5) <= run.precision * std::fabs(averages.mean(5));
+    };
+    double t_end = t_stop;
+
+    computeRates();
+    record(t);
+
+    std::vector<std::string> reactions = monteCarloRealHeader().reactions;
+    reactions.push_back("Af + Fv -> Fv + Af (hop)");
+    RunReport report("lattice Monte Carlo", reactions, !run.reportFilename.empty());
+    ProgressReporter progress(t_stop, run);
+    while (t < t_stop) {
+        report.beginStep();
+        computeRates();
+
+        double totalRate = 0.0;
+        for (double rate : R)
+            totalRate += rate;
+        currentValues();
+        report.phaseDone(RunPhase::Propensities);
+        if (totalRate <= 0) {
+            // Absorbing state: held until t_stop.
+            averages.add(held, t_stop - t);
+            break;
+        }
+
+        double dt = gen.exponential() / totalRate;
+        report.phaseDone(RunPhase::Selection);
+
+        // On a fixed output grid the state is piecewise constant between events.
+        const double t_next = t + dt;
+        double t_grid;
+        while (t_next > t_stop ? sampler.gridPointUpTo(t_stop, t_grid)
+                               : sampler.gridPointBefore(t_next, t_grid))
+            record(t_grid);
+        report.phaseDone(RunPhase::Output);
+
+        if (averages.add(held, std::min(t_next, t_stop) - t) && mayStop
+            && converged(std::min(t_next, t_stop))) {
+            t_end = std::min(t_next, t_stop);
+            break;
+        }
+        report.phaseDone(RunPhase::Statistics);
+
+        t += dt;
+
+        // Event class, then a uniform member of it.
+        double r_choice = gen.uniform() * totalRate;
+        int reaction = 7;
+        for (int c = 0; c < 7; c++) {
+            if (R[c] > 0 && (r_choice -= R[c]) < 0) {
+                reaction = c;
+                break;
+            }
+        }
+        if (R[reaction] <= 0) {
+            // Round-off past the last class: take the last non-empty one.
+            while (R[reaction] <= 0)
+                reaction--;
+        }
+        const double u = gen.uniform();
+        report.phaseDone(RunPhase::Selection);
+
+        const double watchedBefore = population(watched);
+        std::uint32_t s, n;
+        switch (reaction) {
+            case 0: // A + Fv -> Af
+                lattice.set(lattice.pickSite(EmptyF, u), OccupiedF);
+                A--;
+                break;
+            case 1: // Af -> A + Fv
+                lattice.set(lattice.pickSite(OccupiedF, u), EmptyF);
+                A++;
+                break;
+            case 2: // A + Sv -> As
+                lattice.set(lattice.pickSite(EmptyS, u), OccupiedS);
+                A--;
+                break;
+            case 3: // A + As -> A2 + Sv
+                lattice.set(lattice.pickSite(OccupiedS, u), EmptyS);
+                A--;
+                A2++;
+                break;
+            case 4: // Af + Sv -> Fv + As
+                lattice.ends(lattice.pickBond(Trap, u), s, n);
+                lattice.set(s, lattice.at(s) == OccupiedF ? EmptyF : OccupiedS,
+                            n, lattice.at(n) == OccupiedF ? EmptyF : OccupiedS);
+                break;
+            case 5: // Af + As -> A2 + Sv + Fv
+                lattice.ends(lattice.pickBond(RecombineS, u), s, n);
+                lattice.set(s, lattice.at(s) == OccupiedF ? EmptyF : EmptyS,
+                            n, lattice.at(n) == OccupiedF ? EmptyF : EmptyS);
+                A2++;
+                break;
+            case 6: // Af + Af -> A2 + 2 Fv
+                lattice.ends(lattice.pickBond(RecombineF, u), s, n);
+                lattice.set(s, EmptyF, n, EmptyF);
+                A2++;
+                break;
+            default: // Af hops to an empty neighbour
+                lattice.ends(lattice.pickBond(Hop, u), s, n);
+                lattice.set(s, lattice.at(n), n, lattice.at(s));
+                break;
+        }
+        report.fired(static_cast<std::size_t>(reaction));
+        report.phaseDone(RunPhase::Update);
+
+        // Record the updated state (with the rates that selected this event):
+        if (sampler.recordEvent(watchedBefore, population(watched)))
+            record(t);
+
+        progress.update(t);
+        report.phaseDone(RunPhase::Output);
+    }
+    progress.finish(t_end);
+    report.finish(t_end);
+    if (!run.reportFilename.empty() && !report.writeJson(run.reportFilename))
+        std::cerr << "Error opening file: " << run.reportFilename << "\n";
+
+    // Remaining grid points hold the final state.
+    computeRates();
+    double t_grid;
+    while (sampler.gridPointUpTo(t_end, t_grid))
+        record(t_grid);
+
+    // Time averages over the later half of the run; the final state only if
+    // the run was too short to complete a batch.
+    double gamma_ER, gamma_LHS, gamma_LHF, gamma_total;
+    double ci[4];
+    if (averages.batches() > 0) {
+        gamma_ER    = averages.mean(2);
+        gamma_LHS   = averages.mean(3);
+        gamma_LHF   = averages.mean(4);
+        gamma_total = averages.mean(5);
+        for (int i = 0; i < 4; i++)
+            ci[i] = averages.halfWidth(static_cast<std::size_t>(2 + i));
+    } else {
+        currentValues();
+        gamma_ER    = held[2];
+        gamma_LHS   = held[3];
+        gamma_LHF   = held[4];
+        gamma_total = held[5];
+        std::fill(ci, ci + 4, std::numeric_limits<double>::infinity());
+    }
+
+    return {Tw, gamma_ER, gamma_LHS, gamma_LHF, gamma_total,
+            ci[0], ci[1], ci[2], ci[3],
+            averages.mean(0), averages.mean(1), t_end};
+}
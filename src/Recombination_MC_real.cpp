@@ -1,5 +1,17 @@
 #include "Recombination_MC_real.h"
+#include "TrajectoryWriter.h"
+#include "Sampling.h"
+#include "Random.h"
+#include "TimeAverage.h"
+#include "Progress.h"
+#include "RunReport.h"
+#include "Checkpoint.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <random>
 #include <cmath>
@@ -16,8 +28,43 @@ std::vector<double> MonteCarloRecombinationReal(double initial_A, double initial
     double initial_Sv, double initial_A2, double M, double Tg, double Tw,
     double k1, double k3, double k4, double vd,
     double vD, double Ed, double ED, double Er, double ELHF,
-    double t_stop, const std::string& outputFilename)
-    
+    double t_stop, const std::string& outputFilename,
+    const RunOptions& run)
+{
+    // A resumed run continues the file written up to its checkpoint.
+    std::unique_ptr<TrajectoryWriter> writer(run.resumeFrom
+        ? new TrajectoryWriter(outputFilename, monteCarloRealHeader(), *run.resumeFrom)
+        : new TrajectoryWriter(outputFilename, monteCarloRealHeader()));
+    if (run.resumeFrom && !writer->good())
+        return {};
+    std::vector<double> gammas = MonteCarloRecombinationReal(initial_A, initial_Fv,
+        initial_Sv, initial_A2, M, Tg, Tw, k1, k3, k4, vd, vD, Ed, ED, Er, ELHF,
+        t_stop, static_cast<TrajectorySink&>(*writer), run);
+    writer->close();
+    // The output is complete: its checkpoint is no longer needed.
+    if (!gammas.empty() && !run.checkpointFilename.empty())
+        std::remove(run.checkpointFilename.c_str());
+    return gammas;
+}
+
+TrajectoryHeader monteCarloRealHeader()
+{
+    TrajectoryHeader header;
+    header.columns = { "Time", "A", "Fv", "Af", "Sv", "As", "A2",
+                       "R1", "R2", "R3", "R4", "R5", "R6", "R7" };
+    header.nSpecies = 6;
+    header.reactions = { "A + Fv -> Af", "Af -> A + Fv", "A + Sv -> As",
+                         "A + As -> A2 + Sv", "Af + Sv -> Fv + As",
+                         "Af + As -> A2 + Sv + Fv", "2 Af -> A2 + 2 Fv" };
+    return header;
+}
+
+std::vector<double> MonteCarloRecombinationReal(double initial_A, double initial_Fv,
+    double initial_Sv, double initial_A2, double M, double Tg, double Tw,
+    double k1, double k3, double k4, double vd,
+    double vD, double Ed, double ED, double Er, double ELHF,
+    double t_stop, TrajectorySink& sink,
+    const RunOptions& run)
 {
     double gamma_ER    = 0.0;
     double gamma_LHS   = 0.0;
@@ -44,132 +91,258 @@ std::vector<double> MonteCarloRecombinationReal(double initial_A, double initial
     double r6 = tau_d_1 * Pr;
     double r7 = tau_d_1 * Prlh;
 
+    // Exact molecule and site counts.
+    auto count = [](double initial) { return static_cast<std::int64_t>(std::llround(std::max(initial, 0.0))); };
     double t = 0.0;
-    double A = initial_A;
-    double Fv = initial_Fv;
-    double Af = 0.0;
-    double Sv = initial_Sv;
-    double As = 0.0;
-    double A2 = initial_A2;
-
-    const double S = Sv;
-    const double F = Fv;
-
-    std::vector<double> times{ t };
-    std::vector<double> populations_A{ A };
-    std::vector<double> populations_Fv{ Fv };
-    std::vector<double> populations_Af{ Af };
-    std::vector<double> populations_Sv{ Sv };
-    std::vector<double> populations_As{ As };
-    std::vector<double> populations_A2{ A2 };
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
-
-    std::ofstream outFile(outputFilename);
-    if (!outFile)
-    {
-        std::cerr << "Error opening file: " << outputFilename << std::endl;
+    std::int64_t A = count(initial_A);
+    std::int64_t Fv = count(initial_Fv);
+    std::int64_t Af = 0;
+    std::int64_t Sv = count(initial_Sv);
+    std::int64_t As = 0;
+    std::int64_t A2 = count(initial_A2);
+
+    const double S = static_cast<double>(Sv);
+    const double F = static_cast<double>(Fv);
+
+    Rng gen = makeGenerator(run);
+
+    const SamplingPolicy& sampling = run.sampling;
+    TrajectorySampler sampler(sampling);
+
+    // Populations in column order, for the OnChange watched species.
+    std::int64_t* const populations[] = { &A, &Fv, &Af, &Sv, &As, &A2 };
+    const int watched = (sampling.species >= 0 && sampling.species < 6) ? sampling.species : 0;
+
+    // A rate is zero unless its reactants are present, so the chosen
+    // reaction can always fire.
+    double R1 = 0, R2 = 0, R3 = 0, R4 = 0, R5 = 0, R6 = 0, R7 = 0;
+    auto computeRates = [&]() {
+        const double a = static_cast<double>(A), fv = static_cast<double>(Fv), af = static_cast<double>(Af),
+                     sv = static_cast<double>(Sv), as = static_cast<double>(As);
+        R1 = r1 * a * fv;      // A + Fv -> Af
+        R2 = r2 * af;          // Af -> A + Fv
+        R3 = r3 * a * sv;      // A + Sv -> As
+        R4 = r4 * a * as;      // A + As -> A2 + Sv
+        R5 = r5 * af * sv;     // Af + Sv -> Fv + As
+        R6 = r6 * af * as;     // Af + As -> A2 + Sv + Fv
+        R7 = (Af >= 2) ? r7 * af * af : 0;  // Af + Af -> A2 + 2 Fv
+    };
+    auto record = [&](double time) {
+        const double row[] = { time, static_cast<double>(A), static_cast<double>(Fv), static_cast<double>(Af),
+                               static_cast<double>(Sv), static_cast<double>(As), static_cast<double>(A2),
+                               R1, R2, R3, R4, R5, R6, R7 };
+        sink.writeRow(row);
+    };
+
+    // Time-weighted accumulators of the coverages and of the instantaneous
+    // recombination probabilities: Af, As, gamma_ER, gamma_LHS, gamma_LHF, gamma_total.
+    TimeAverages averages(6);
+    double held[6];
+    auto currentValues = [&]() {
+        const double af = static_cast<double>(Af), as = static_cast<double>(As);
+        held[0] = af;
+        held[1] = as;
+        held[2] = 2 * r4 * as * S / (phi_O * (S + F));
+        held[3] = 2 * r6 * as * af * S / (phi_O * (S + F));
+        held[4] = 2 * r7 * af * af * F / (phi_O * (S + F));
+        held[5] = held[2] + held[3] + held[4];
+    };
+    // Stop criteria, checked as batches complete: gamma_total has been
+    // stationary since at most half the current time (a single test passes
+    // spuriously at turning points) and, unless stopping at steady state, is
+    // within the requested precision.
+    const bool mayStop = run.precision > 0.0 || run.stopAtSteadyState;
+    double stationarySince = -1.0;
+    auto converged = [&](double now) {
+        if (!averages.stationary(5)) {
+            stationarySince = -1.0;
+            return false;
+        }
+        if (stationarySince < 0.0)
+            stationarySince = now;
+        if (now < 2.0 * stationarySince)
+            return false;
+        return run.stopAtSteadyState
+            || averages.halfWidth(5) <= run.precision * std::fabs(averages.mean(5));
+    };
+    double t_end = t_stop;
+
+    RunReport report("Monte Carlo (7 reactions)", monteCarloRealHeader().reactions,
+                     !run.reportFilename.empty());
+
+    // Checkpoints: populations, time, random stream position, sampler, time
+    // averages, convergence state and firings, with the sink's position.
+    CheckpointSchedule checkpoints(run.checkpointFilename.empty() ? 0.0 : run.checkpointInterval);
+    auto saveCheckpoint = [&]() {
+        Checkpoint checkpoint = checkpointOf(run);
+        // Counts below 2^53 are exact as doubles.
+        checkpoint.putDoubles("mc.state", { t, static_cast<double>(A), static_cast<double>(Fv),
+                                            static_cast<double>(Af), static_cast<double>(Sv),
+                                            static_cast<double>(As), static_cast<double>(A2),
+                                            stationarySince });
+        checkpoint.putInteger("rng.position", gen.position());
+        sampler.saveTo(checkpoint);
+        averages.saveTo(checkpoint, "mc.averages");
+        report.saveTo(checkpoint);
+        if (!sink.saveTo(checkpoint) || !checkpoint.save(run.checkpointFilename))
+            std::cerr << "Cannot write the checkpoint " << run.checkpointFilename << "\n";
+    };
+
+    if (run.resumeFrom) {
+        const Checkpoint& checkpoint = *run.resumeFrom;
+        std::vector<double> saved;
+        std::uint64_t position;
+        if (!checkpoint.getDoubles("mc.state", saved) || saved.size() != 8 ||
+            !checkpoint.getInteger("rng.position", position) || !sampler.restoreFrom(checkpoint) ||
+            !averages.restoreFrom(checkpoint, "mc.averages") || !report.restoreFrom(checkpoint)) {
+            std::cerr << "Cannot resume the Monte Carlo run from " << run.checkpointFilename << "\n";
+            return {};
+        }
+        t = saved[0];
+        A = count(saved[1]);
+        Fv = count(saved[2]);
+        Af = count(saved[3]);
+        Sv = count(saved[4]);
+        As = count(saved[5]);
+        A2 = count(saved[6]);
+        stationarySince = saved[7];
+        gen.seek(position);
+    } else {
+        computeRates();
+        record(t);
     }
-    
-    outFile << "Time\tA\tFv\tAf\tSv\tAs\tA2\tR1\tR2\tR3\tR4\tR5\tR6\tR7\n";
 
+    ProgressReporter progress(t_stop, run);
     while (t < t_stop) {
-        double R1 = r1 * A * Fv;      // A + Fv -> Af
-        double R2 = r2 * Af;          // Af -> A + Fv
-        double R3 = r3 * A * Sv;      // A + Sv -> As
-        double R4 = r4 * A * As;      // A + As -> A2 + Sv
-        double R5 = r5 * Af * Sv;     // Af + Sv -> Fv + As
-        double R6 = r6 * Af * As;     // Af + As -> A2 + Sv + Fv
-        double R7 = (Af >= 2) ? r7 * Af * Af : 0;  // Af + Af -> A2 + 2 Fv
+        report.beginStep();
+        computeRates();
 
         double totalRate = R1 + R2 + R3 + R4 + R5 + R6 + R7;
-        if (totalRate <= 0) break;
+        currentValues();
+        report.phaseDone(RunPhase::Propensities);
+        if (totalRate <= 0) {
+            // Absorbing state: held until t_stop.
+            averages.add(held, t_stop - t);
+            break;
+        }
+
+        double dt = gen.exponential() / totalRate;
+        report.phaseDone(RunPhase::Selection);
+
+        // On a fixed output grid the state is piecewise constant between events.
+        const double t_next = t + dt;
+        double t_grid;
+        while (t_next > t_stop ? sampler.gridPointUpTo(t_stop, t_grid)
+                               : sampler.gridPointBefore(t_next, t_grid))
+            record(t_grid);
+        report.phaseDone(RunPhase::Output);
+
+        // The current state is held until the event (or t_stop).
+        if (averages.add(held, std::min(t_next, t_stop) - t) && mayStop
+            && converged(std::min(t_next, t_stop))) {
+            t_end = std::min(t_next, t_stop);
+            break;
+        }
+        report.phaseDone(RunPhase::Statistics);
 
-        double r_time = dis(gen);
-        double dt = -std::log(r_time) / totalRate;
         t += dt;
 
-        double r_choice = dis(gen) * totalRate;
+        double r_choice = gen.uniform() * totalRate;
         double cumulative = 0.0;
         int reaction = -1;
 
-        if ((cumulative += R1) >= r_choice)
+        // Strictly past r_choice, so a reaction of rate zero is never chosen.
+        if ((cumulative += R1) > r_choice)
             reaction = 1;
-        else if ((cumulative += R2) >= r_choice)
+        else if ((cumulative += R2) > r_choice)
             reaction = 2;
-        else if ((cumulative += R3) >= r_choice)
+        else if ((cumulative += R3) > r_choice)
             reaction = 3;
-        else if ((cumulative += R4) >= r_choice)
+        else if ((cumulative += R4) > r_choice)
             reaction = 4;
-        else if ((cumulative += R5) >= r_choice)
+        else if ((cumulative += R5) > r_choice)
             reaction = 5;
-        else if ((cumulative += R6) >= r_choice)
+        else if ((cumulative += R6) > r_choice)
             reaction = 6;
-        else if ((cumulative += R7) >= r_choice)
+        else if ((cumulative += R7) > r_choice)
             reaction = 7;
+        report.phaseDone(RunPhase::Selection);
 
-        // Update species counts based on the chosen reaction:
+        const double watchedBefore = static_cast<double>(*populations[watched]);
+
+        // Update species counts based on the chosen reaction (its rate was
+        // positive, so its reactants are present):
         switch (reaction)
         {
             case 1: // A + Fv -> Af
-                if (A > 0 && Fv > 0) { A--; Fv--; Af++; }
-                //if (A > 0 && Fv > 0) {Fv--; Af++; }
+                A--; Fv--; Af++;
                 break;
             case 2: // Af -> A + Fv
-                if (Af > 0) { Af--; A++; Fv++; }
-                //if (Af > 0) { Af--; Fv++; }
+                Af--; A++; Fv++;
                 break;
             case 3: // A + Sv -> As
-                if (A > 0 && Sv > 0) { A--; Sv--; As++; }
-                //if (A > 0 && Sv > 0) { Sv--; As++; }
+                A--; Sv--; As++;
                 break;
             case 4: // A + As -> A2 + Sv
-                if (A > 0 && As > 0) { A--; As--; A2++; Sv++; }
-                //if (A > 0 && As > 0) { As--; A2++; Sv++; }
+                A--; As--; A2++; Sv++;
                 break;
             case 5: // Af + Sv -> Fv + As
-                if (Af > 0 && Sv > 0) { Af--; Sv--; Fv++; As++; }
+                Af--; Sv--; Fv++; As++;
                 break;
             case 6: // Af + As -> A2 + Sv + Fv
-                if (Af > 0 && As > 0) { Af--; As--; A2++; Sv++; Fv++; }
+                Af--; As--; A2++; Sv++; Fv++;
                 break;
             case 7: // Af + Af -> A2 + 2 Fv
-                if (Af >= 2) { Af -= 2; A2++; Fv += 2; }
+                Af -= 2; A2++; Fv += 2;
                 break;
             default:
                 break;
         }
+        if (reaction > 0)
+            report.fired(static_cast<std::size_t>(reaction - 1));
+        report.phaseDone(RunPhase::Update);
 
-        // Record the updated state:
-        times.push_back(t);
-        populations_A.push_back(A);
-        populations_Fv.push_back(Fv);
-        populations_Af.push_back(Af);
-        populations_Sv.push_back(Sv);
-        populations_As.push_back(As);
-        populations_A2.push_back(A2);
-
+        // Record the updated state (with the rates that selected this event):
+        if (sampler.recordEvent(watchedBefore, static_cast<double>(*populations[watched])))
+            record(t);
 
-        // Print current state to console
-        std::cout << t << "\t" << A << "\t" << Fv << "\t" << Af << "\t"
-                  << Sv << "\t" << As << "\t" << A2  << "\n";
-
-        outFile << t << "\t" << A << "\t" << Fv << "\t" << Af << "\t"
-        << Sv << "\t" << As << "\t" << A2 << "\t" << R1 << "\t" << R2 << "\t" << R3 << "\t"
-        << R4 << "\t" << R5 << "\t" << R6 << "\t" << R7 << "\n";
-        
+        progress.update(t);
+        if (checkpoints.due())
+            saveCheckpoint();
+        report.phaseDone(RunPhase::Output);
     }
+    progress.finish(t_end);
+    report.finish(t_end);
+    if (!run.reportFilename.empty() && !report.writeJson(run.reportFilename))
+        std::cerr << "Error opening file: " << run.reportFilename << "\n";
 
+    // Remaining grid points hold the final state.
+    computeRates();
+    double t_grid;
+    while (sampler.gridPointUpTo(t_end, t_grid))
+        record(t_grid);
 
-    outFile.close();
-
-    gamma_ER    = 2 * r4 * As * S / (phi_O * (S + F));
-    gamma_LHS   = 2 * r6 * As * Af * S / (phi_O * (S + F));
-    gamma_LHF   = 2 * r7 * Af * Af * F / (phi_O * (S + F));
-    gamma_total = gamma_ER + gamma_LHF + gamma_LHS;
+    // Time averages over the later half of the run; the final state only if
+    // the run was too short to complete a batch.
+    double ci[4];
+    if (averages.batches() > 0) {
+        gamma_ER    = averages.mean(2);
+        gamma_LHS   = averages.mean(3);
+        gamma_LHF   = averages.mean(4);
+        gamma_total = averages.mean(5);
+        for (int i = 0; i < 4; i++)
+            ci[i] = averages.halfWidth(static_cast<std::size_t>(2 + i));
+    } else {
+        currentValues();
+        gamma_ER    = held[2];
+        gamma_LHS   = held[3];
+        gamma_LHF   = held[4];
+        gamma_total = held[5];
+        std::fill(ci, ci + 4, std::numeric_limits<double>::infinity());
+    }
 
-    return {Tw, gamma_ER, gamma_LHS, gamma_LHF, gamma_total};
+    return {Tw, gamma_ER, gamma_LHS, gamma_LHF, gamma_total,
+            ci[0], ci[1], ci[2], ci[3],
+            averages.mean(0), averages.mean(1), t_end};
 
 }
@@ -1,4 +1,9 @@
 #include "Recombination_RK.h"
+#include "TrajectoryWriter.h"
+#include "Sampling.h"
+#include "RunReport.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <random>
@@ -37,7 +42,41 @@ dAsdt =  R3 - R4 + R5 - R6;
 dA2dt =  R4 + R6 + R7;
 }
 
-static void rk4Step6(double r1, double r2, double r3, double r4,
+// Analytic Jacobian J[i][j] = d(dy_i/dt)/dy_j of derivatives6, with species in
+// the order A, Fv, Af, Sv, As, A2: stoichiometry times the rate gradients.
+static void jacobian6(double r1, double r2, double r3, double r4,
+    double r5, double r6, double r7,
+    const std::array<double, 6>& y, OdeMatrix<6>& J)
+{
+const double A = y[0], Fv = y[1], Af = y[2], Sv = y[3], As = y[4];
+// dR[k][j] = dR_k/dy_j
+const double dR[7][6] = {
+{ r1 * Fv, r1 * A, 0, 0, 0, 0 },              // R1 = r1 A Fv
+{ 0, 0, r2, 0, 0, 0 },                        // R2 = r2 Af
+{ r3 * Sv, 0, 0, r3 * A, 0, 0 },              // R3 = r3 A Sv
+{ r4 * As, 0, 0, 0, r4 * A, 0 },              // R4 = r4 A As
+{ 0, 0, r5 * Sv, r5 * Af, 0, 0 },             // R5 = r5 Af Sv
+{ 0, 0, r6 * As, 0, r6 * Af, 0 },             // R6 = r6 Af As
+{ 0, 0, 2.0 * r7 * Af, 0, 0, 0 } };           // R7 = r7 Af^2
+// nu[i][k]: change of species i per firing of reaction k (as in derivatives6).
+const double nu[6][7] = {
+{ -1,  1, -1, -1,  0,  0,  0 },
+{ -1,  1,  0,  0,  1,  1,  2 },
+{  1, -1,  0,  0, -1, -1, -2 },
+{  0,  0, -1,  1, -1,  1,  0 },
+{  0,  0,  1, -1,  1, -1,  0 },
+{  0,  0,  0,  1,  0,  1,  1 } };
+for (int i = 0; i < 6; i++) {
+for (int j = 0; j < 6; j++) {
+double sum = 0.0;
+for (int k = 0; k < 7; k++)
+sum += nu[i][k] * dR[k][j];
+J[i][j] = sum;
+}
+}
+}
+
+void rk4Step6(double r1, double r2, double r3, double r4,
 double r5, double r6, double r7,
 double& A,  double& Fv, double& Af,
 double& Sv, double& As, double& A2,
@@ -104,7 +143,9 @@ void RungeKuttaRecombination(double A,  double Fv, double Af,
                 double k3, double k4, double Er, double ELHF,
                 double vD, double ED,
                 double dt, double tMax,
-                const std::string& outputFilename)
+                const std::string& outputFilename,
+                const SamplingPolicy& sampling,
+                const OdeSettings& ode)
 {
 double kb = 1.380649e-23;
 double Na = 6.023e23;
@@ -124,6 +165,7 @@ double r5 = 0.75 * tau_d;
 double r6 = tau_d * (k4 * std::exp(-Er / (Na * kb * Tw)));
 double r7 = tau_d * (k4 * std::exp(-ELHF / (Na * kb * Tw)));
 
+if (ode.verbose) {
 cout << "Computed reaction rates:" << "\n";
 cout << "r1 = " << r1 << "\n";
 cout << "r2 = " << r2 << "\n";
@@ -132,39 +174,153 @@ cout << "r4 = " << r4 << "\n";
 cout << "r5 = " << r5 << "\n";
 cout << "r6 = " << r6 << "\n";
 cout << "r7 = " << r7 << "\n";
+}
 
 double t = 0.0;
-ofstream outFile(outputFilename);
-if (!outFile) {
-cerr << "Error opening file: " << outputFilename << "\n";
+TrajectoryHeader header;
+header.columns = { "Time", "A", "Fv", "Af", "Sv", "As", "A2",
+                   "R1", "R2", "R3", "R4", "R5", "R6", "R7" };
+header.nSpecies = 6;
+header.integerCounts = false;
+header.reactions = { "A + Fv -> Af", "Af -> A + Fv", "A + Sv -> As",
+                     "A + As -> A2 + Sv", "Af + Sv -> Fv + As",
+                     "Af + As -> A2 + Sv + Fv", "2 Af -> A2 + 2 Fv" };
+TrajectoryWriter writer(outputFilename, header);
+if (!writer.good())
 return;
-}
 
-// Write header (populations and reaction rates)
-outFile << "Time\tA\tFv\tAf\tSv\tAs\tA2\tR1\tR2\tR3\tR4\tR5\tR6\tR7\n";
+// Write populations and reaction rates, starting with the initial state.
+auto writeState = [&](double time, const double y[6]) {
+double curr_R1 = r1 * y[0] * y[1];
+double curr_R2 = r2 * y[2];
+double curr_R3 = r3 * y[0] * y[3];
+double curr_R4 = r4 * y[0] * y[4];
+double curr_R5 = r5 * y[2] * y[3];
+double curr_R6 = r6 * y[2] * y[4];
+double curr_R7 = (y[2] >= 2) ? r7 * y[2] * y[2] : 0.0;
+const double row[] = { time, y[0], y[1], y[2], y[3], y[4], y[5],
+curr_R1, curr_R2, curr_R3, curr_R4, curr_R5, curr_R6, curr_R7 };
+writer.writeRow(row);
+};
 
-outFile << t << "\t" << A << "\t" << Fv << "\t" << Af << "\t" << Sv << "\t" << As << "\t" << A2;
+// Slopes at the start of each step, for cubic Hermite interpolation onto
+// a fixed output grid independent of dt.
+TrajectorySampler sampler(sampling);
+const int watched = (sampling.species >= 0 && sampling.species < 6) ? sampling.species : 0;
+double y0[6] = { A, Fv, Af, Sv, As, A2 };
+double f0[6];
+derivatives6(r1, r2, r3, r4, r5, r6, r7, A, Fv, Af, Sv, As, A2,
+f0[0], f0[1], f0[2], f0[3], f0[4], f0[5]);
+writeState(t, y0);
 
+// Performance report: reaction extents (integrated rates, trapezoidal per
+// step), step counts and the split between stepping and output.
+const bool reporting = !ode.reportFilename.empty();
+const char* methodNames[] = { "RK4", "Dormand-Prince 5(4)", "Rosenbrock 2(3)" };
+RunReport report(methodNames[static_cast<int>(ode.method)], header.reactions, reporting);
+auto addExtents = [&](const double ya[6], const double yb[6], double h) {
+const double R[7] = {
+r1 * (ya[0] * ya[1] + yb[0] * yb[1]), r2 * (ya[2] + yb[2]),
+r3 * (ya[0] * ya[3] + yb[0] * yb[3]), r4 * (ya[0] * ya[4] + yb[0] * yb[4]),
+r5 * (ya[2] * ya[3] + yb[2] * yb[3]), r6 * (ya[2] * ya[4] + yb[2] * yb[4]),
+r7 * (ya[2] * ya[2] + yb[2] * yb[2]) };
+for (std::size_t k = 0; k < 7; k++)
+report.fired(k, 0.5 * h * R[k]);
+};
+auto writeReport = [&](double tEnd) {
+report.finish(tEnd);
+if (reporting && !report.writeJson(ode.reportFilename))
+cerr << "Error opening file: " << ode.reportFilename << "\n";
+};
+
+// Adaptive methods: grid points come from the dense output.
+if (ode.method != OdeMethod::RK4) {
+auto rhs = [&](double, const std::array<double, 6>& y, std::array<double, 6>& dydt) {
+derivatives6(r1, r2, r3, r4, r5, r6, r7, y[0], y[1], y[2], y[3], y[4], y[5],
+dydt[0], dydt[1], dydt[2], dydt[3], dydt[4], dydt[5]);
+};
+auto jac = [&](double, const std::array<double, 6>& y, OdeMatrix<6>& J) {
+jacobian6(r1, r2, r3, r4, r5, r6, r7, y, J);
+};
+// Each step is timed from the end of the previous onStep call.
+auto onStep = [&](const DenseStep<6>& step) {
+report.phaseDone(RunPhase::Update);
+if (reporting)
+addExtents(step.y0.data(), step.y1.data(), step.t1 - step.t0);
+report.phaseDone(RunPhase::Statistics);
+if (sampler.fixedGrid()) {
+double t_grid;
+while (sampler.gridPointUpTo(step.t1, t_grid))
+writeState(t_grid, step.eval(t_grid).data());
+}
+else if (sampler.recordEvent(std::floor(step.y0[watched]), std::floor(step.y1[watched]))) {
+writeState(step.t1, step.y1.data());
+}
+report.phaseDone(RunPhase::Output);
+report.beginStep();
+};
+std::array<double, 6> y = { A, Fv, Af, Sv, As, A2 };
+const bool stiff = (ode.method == OdeMethod::Rosenbrock23);
+report.beginStep();
+OdeStats stats = stiff
+? integrateRosenbrock23<6>(rhs, jac, t, tMax, y, ode.tolerances, onStep)
+: integrateDormandPrince<6>(rhs, t, tMax, y, ode.tolerances, onStep);
+const char* name = stiff ? "Rosenbrock 2(3)" : "Dormand-Prince 5(4)";
+if (ode.verbose)
+cout << name << ": " << stats.accepted << " steps, " << stats.rejected
+     << " rejected, " << stats.rhsCalls << " derivative evaluations\n";
+if (stats.failed)
+cerr << name << " stopped before tMax (step size too small or too many steps)\n";
+report.set("accepted_steps", static_cast<double>(stats.accepted));
+report.set("rejected_steps", static_cast<double>(stats.rejected));
+report.set("derivative_evaluations", static_cast<double>(stats.rhsCalls));
+writer.close();
+writeReport(tMax);
+return;
+}
 
 while (t < tMax) {
+report.beginStep();
+const double t0 = t;
 rk4Step6(r1, r2, r3, r4, r5, r6, r7, A, Fv, Af, Sv, As, A2, t, dt);
+const double y1[6] = { A, Fv, Af, Sv, As, A2 };
+report.phaseDone(RunPhase::Update);
+if (reporting)
+addExtents(y0, y1, t - t0);
+report.phaseDone(RunPhase::Statistics);
 
-double curr_R1 = r1 * A * Fv;
-double curr_R2 = r2 * Af;
-double curr_R3 = r3 * A * Sv;
-double curr_R4 = r4 * A * As;
-double curr_R5 = r5 * Af * Sv;
-double curr_R6 = r6 * Af * As;
-double curr_R7 = (Af >= 2) ? r7 * Af * Af : 0.0;
-
-outFile << t << "\t" << A << "\t" << Fv << "\t" << Af << "\t" 
-<< Sv << "\t" << As << "\t" << A2;
-outFile << "\t" << curr_R1 << "\t" << curr_R2 << "\t" << curr_R3 
-<< "\t" << curr_R4 << "\t" << curr_R5 << "\t" << curr_R6 
-<< "\t" << curr_R7 << "\n";
+if (sampler.fixedGrid()) {
+double f1[6];
+derivatives6(r1, r2, r3, r4, r5, r6, r7, A, Fv, Af, Sv, As, A2,
+f1[0], f1[1], f1[2], f1[3], f1[4], f1[5]);
+const double h = t - t0;
+double t_grid;
+while (sampler.gridPointUpTo(std::min(t, tMax), t_grid)) {
+double u = (t_grid - t0) / h;
+double h00 = (1 + 2 * u) * (1 - u) * (1 - u);
+double h10 = u * (1 - u) * (1 - u);
+double h01 = u * u * (3 - 2 * u);
+double h11 = u * u * (u - 1);
+double y[6];
+for (int i = 0; i < 6; i++)
+y[i] = h00 * y0[i] + h10 * h * f0[i] + h01 * y1[i] + h11 * h * f1[i];
+writeState(t_grid, y);
+}
+std::copy(f1, f1 + 6, f0);
+}
+// OnChange watches the integer part of the (continuous) population.
+else if (sampler.recordEvent(std::floor(y0[watched]), std::floor(y1[watched]))) {
+writeState(t, y1);
+}
+std::copy(y1, y1 + 6, y0);
+report.phaseDone(RunPhase::Output);
 }
 
-outFile.close();
+// Four per RK4 step, plus the end slope for grid interpolation.
+const double perStep = sampler.fixedGrid() ? 5.0 : 4.0;
+report.set("derivative_evaluations", perStep * static_cast<double>(report.stepCount()));
+writer.close();
+writeReport(t);
 
 }
 
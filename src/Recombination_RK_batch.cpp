@@ -0,0 +1,139 @@
+#include "Recombination_RK.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifndef pi
+#define pi 3.14159265358979323846
+#endif
+
+using namespace std;
+
+// Runtime dispatch between AVX-512, AVX2 and a baseline build of the kernel.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PSR_SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define PSR_SIMD_CLONES
+#endif
+
+namespace {
+
+const size_t lanes = 8;
+
+// Populations (A, Fv, Af, Sv, As, A2) and rate constants r1..r7 of a block
+// of parameter points, one lane per point.
+struct LaneBlock {
+    double y[6][lanes];
+    double r[7][lanes];
+};
+
+// derivatives6 for every lane.
+inline void derivativesLanes(const double (&r)[7][lanes], const double (&y)[6][lanes],
+                             double (&dy)[6][lanes])
+{
+    for (size_t l = 0; l < lanes; l++) {
+        const double R1 = r[0][l] * y[0][l] * y[1][l];
+        const double R2 = r[1][l] * y[2][l];
+        const double R3 = r[2][l] * y[0][l] * y[3][l];
+        const double R4 = r[3][l] * y[0][l] * y[4][l];
+        const double R5 = r[4][l] * y[2][l] * y[3][l];
+        const double R6 = r[5][l] * y[2][l] * y[4][l];
+        const double R7 = r[6][l] * y[2][l] * y[2][l];
+        dy[0][l] = -R1 + R2 - R3 - R4;
+        dy[1][l] = -R1 + R2 + R5 + R6 + 2.0 * R7;
+        dy[2][l] =  R1 - R2 - R5 - R6 - 2.0 * R7;
+        dy[3][l] = -R3 + R4 - R5 + R6;
+        dy[4][l] =  R3 - R4 + R5 - R6;
+        dy[5][l] =  R4 + R6 + R7;
+    }
+}
+
+// tmp = y + c * k for every species and lane.
+inline void offsetLanes(const double (&y)[6][lanes], const double (&k)[6][lanes], double c,
+                        double (&tmp)[6][lanes])
+{
+    for (size_t i = 0; i < 6; i++)
+        for (size_t l = 0; l < lanes; l++)
+            tmp[i][l] = y[i][l] + c * k[i][l];
+}
+
+}
+
+// The classical RK4 step of rk4Step6, applied to all lanes of the block.
+PSR_SIMD_CLONES
+static void rk4Lanes(LaneBlock& block, long steps, double dt)
+{
+    double k1[6][lanes], k2[6][lanes], k3[6][lanes], k4[6][lanes], tmp[6][lanes];
+    for (long n = 0; n < steps; n++) {
+        derivativesLanes(block.r, block.y, k1);
+        offsetLanes(block.y, k1, 0.5 * dt, tmp);
+        derivativesLanes(block.r, tmp, k2);
+        offsetLanes(block.y, k2, 0.5 * dt, tmp);
+        derivativesLanes(block.r, tmp, k3);
+        offsetLanes(block.y, k3, dt, tmp);
+        derivativesLanes(block.r, tmp, k4);
+        for (size_t i = 0; i < 6; i++)
+            for (size_t l = 0; l < lanes; l++)
+                block.y[i][l] += (dt / 6.0) * (k1[i][l] + 2.0 * k2[i][l] + 2.0 * k3[i][l] + k4[i][l]);
+    }
+}
+
+vector<RecombinationResult> RungeKuttaRecombinationBatch(
+    const vector<RecombinationPoint>& points,
+    double M, double k1, double vd,
+    double k3, double k4, double vD,
+    double dt, double tMax)
+{
+    const double kb = 1.380649e-23;
+    const double Na = 6.023e23;
+
+    // Same step count as the scalar loop, which stops once t reaches tMax.
+    long steps = 0;
+    for (double t = 0.0; t < tMax; t += dt)
+        steps++;
+
+    vector<RecombinationResult> results(points.size());
+    vector<double> phi(lanes);
+    for (size_t first = 0; first < points.size(); first += lanes) {
+        // A partial last block repeats its final point in the spare lanes.
+        LaneBlock block;
+        for (size_t l = 0; l < lanes; l++) {
+            const RecombinationPoint& p = points[min(first + l, points.size() - 1)];
+            const double RT = Na * kb * p.Tw;
+            const double v_med = std::sqrt((8 * kb * p.Tg * Na) / (pi * M));
+            phi[l] = 0.25 * v_med * p.O;
+            const double tau_d = vD * std::exp(-p.ED / RT);
+
+            block.r[0][l] = k1 * phi[l];
+            block.r[1][l] = vd * std::exp(-p.Ed / RT);
+            block.r[2][l] = k3 * phi[l];
+            block.r[3][l] = k4 * std::exp(-p.Er / RT) * block.r[2][l];
+            block.r[4][l] = 0.75 * tau_d;
+            block.r[5][l] = tau_d * (k4 * std::exp(-p.Er / RT));
+            block.r[6][l] = tau_d * (k4 * std::exp(-p.ELHF / RT));
+
+            const double y0[6] = { p.O, p.Fv, 0.0, p.Sv, 0.0, 0.0 };
+            for (size_t i = 0; i < 6; i++)
+                block.y[i][l] = y0[i];
+        }
+
+        rk4Lanes(block, steps, dt);
+
+        for (size_t l = 0; l < lanes && first + l < points.size(); l++) {
+            const RecombinationPoint& p = points[first + l];
+            RecombinationResult& res = results[first + l];
+            res.A  = block.y[0][l];
+            res.Fv = block.y[1][l];
+            res.Af = block.y[2][l];
+            res.Sv = block.y[3][l];
+            res.As = block.y[4][l];
+            res.A2 = block.y[5][l];
+            const double norm = phi[l] * (p.Sv + p.Fv);
+            res.gamma_ER  = 2 * block.r[3][l] * res.As * p.Sv / norm;
+            res.gamma_LHS = 2 * block.r[5][l] * res.As * res.Af * p.Sv / norm;
+            res.gamma_LHF = 2 * block.r[6][l] * res.Af * res.Af * p.Fv / norm;
+            res.gamma_total = res.gamma_ER + res.gamma_LHS + res.gamma_LHF;
+        }
+    }
+    return results;
+}
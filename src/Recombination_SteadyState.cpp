@@ -0,0 +1,165 @@
+#include "Recombination_SteadyState.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifndef pi
+#define pi 3.14159265358979323846
+#endif
+
+using namespace std;
+
+// Reduced balance of the surface: x = Af, y = As, with Fv = F - x, Sv = S - y
+// and the gas population held at A.
+struct SurfaceBalance {
+    double r1, r2, r3, r4, r5, r6, r7;
+    double A, F, S;
+
+    // dAf/dt and dAs/dt of derivatives6.
+    void residual(double x, double y, double& f1, double& f2) const
+    {
+        const double Fv = F - x, Sv = S - y;
+        f1 = r1 * A * Fv - r2 * x - r5 * x * Sv - r6 * x * y - 2.0 * r7 * x * x;
+        f2 = r3 * A * Sv - r4 * A * y + r5 * x * Sv - r6 * x * y;
+    }
+
+    void jacobian(double x, double y, double J[2][2]) const
+    {
+        const double Sv = S - y;
+        J[0][0] = -r1 * A - r2 - r5 * Sv - r6 * y - 4.0 * r7 * x;
+        J[0][1] = (r5 - r6) * x;
+        J[1][0] = r5 * Sv - r6 * y;
+        J[1][1] = -r3 * A - r4 * A - r5 * x - r6 * x;
+    }
+
+    // Residual in units of site fractions per second, for the line search.
+    // A kind of site that is absent (F or S = 0) has a zero balance.
+    double merit(double x, double y) const
+    {
+        double f1, f2;
+        residual(x, y, f1, f2);
+        const double u = F > 0.0 ? f1 / F : 0.0;
+        const double v = S > 0.0 ? f2 / S : 0.0;
+        return u * u + v * v;
+    }
+
+    // Sum of the magnitudes of the terms of each balance, the scale the
+    // residual is compared with.
+    void grossRates(double x, double y, double& g1, double& g2) const
+    {
+        const double Fv = F - x, Sv = S - y;
+        g1 = r1 * A * Fv + r2 * x + r5 * x * Sv + r6 * x * y + 2.0 * r7 * x * x;
+        g2 = r3 * A * Sv + r4 * A * y + r5 * x * Sv + r6 * x * y;
+    }
+};
+
+// Damped Newton iterations from (x, y). Steps are shortened to stay inside
+// [0, F] x [0, S] and halved until the residual decreases; if no step
+// lowers it, the iteration stops where it is. Returns whether the iteration
+// converged.
+static bool newton(const SurfaceBalance& b, double& x, double& y)
+{
+    const int maxIterations = 100;
+    const double tolerance = 1e-12;
+    for (int it = 0; it < maxIterations; it++) {
+        double f1, f2, g1, g2;
+        b.residual(x, y, f1, f2);
+        b.grossRates(x, y, g1, g2);
+        if (fabs(f1) <= tolerance * g1 && fabs(f2) <= tolerance * g2)
+            return true;
+
+        double J[2][2];
+        b.jacobian(x, y, J);
+        const double det = J[0][0] * J[1][1] - J[0][1] * J[1][0];
+        if (det == 0.0 || !isfinite(det))
+            return false;
+        const double dx = -( J[1][1] * f1 - J[0][1] * f2) / det;
+        const double dy = -(-J[1][0] * f1 + J[0][0] * f2) / det;
+
+        double lambda = 1.0;
+        if (x + dx < 0.0) lambda = min(lambda, -x / dx);
+        if (x + dx > b.F) lambda = min(lambda, (b.F - x) / dx);
+        if (y + dy < 0.0) lambda = min(lambda, -y / dy);
+        if (y + dy > b.S) lambda = min(lambda, (b.S - y) / dy);
+
+        const double m0 = b.merit(x, y);
+        double xn = x + lambda * dx, yn = y + lambda * dy;
+        bool decreased = b.merit(xn, yn) < m0;
+        for (int halving = 0; halving < 60 && !decreased; halving++) {
+            lambda *= 0.5;
+            xn = x + lambda * dx;
+            yn = y + lambda * dy;
+            decreased = b.merit(xn, yn) < m0;
+        }
+        // Stalled: converged only if already at the residual's round-off level.
+        if (!decreased || (xn == x && yn == y))
+            return fabs(f1) <= 1e-8 * g1 && fabs(f2) <= 1e-8 * g2;
+        x = xn;
+        y = yn;
+    }
+    return false;
+}
+
+vector<SteadyState> SteadyStateRecombination(double O, double Fv0, double Sv0,
+    double M, double Tg, double Tw,
+    double k1, double vd, double Ed,
+    double k3, double k4, double Er, double ELHF,
+    double vD, double ED)
+{
+    const double kb = 1.380649e-23;
+    const double Na = 6.023e23;
+
+    const double v_med = std::sqrt((8 * kb * Tg * Na) / (pi * M));
+    const double phi_O = 0.25 * v_med * O;
+    const double tau_d = vD * std::exp(-ED / (Na * kb * Tw));
+
+    SurfaceBalance b;
+    b.r1 = k1 * phi_O;
+    b.r2 = vd * std::exp(-Ed / (Na * kb * Tw));
+    b.r3 = k3 * phi_O;
+    b.r4 = k4 * std::exp(-Er / (Na * kb * Tw)) * b.r3;
+    b.r5 = 0.75 * tau_d;
+    b.r6 = tau_d * (k4 * std::exp(-Er / (Na * kb * Tw)));
+    b.r7 = tau_d * (k4 * std::exp(-ELHF / (Na * kb * Tw)));
+    b.A = O;
+    b.F = Fv0;
+    b.S = Sv0;
+    // No surface: no steady state to report (the gammas are per site).
+    if (!(Fv0 >= 0.0 && Sv0 >= 0.0 && Fv0 + Sv0 > 0.0))
+        return {};
+
+    // Multi-start over the coverages, including the empty and full surfaces.
+    const double fractions[] = { 0.0, 1e-3, 0.1, 0.5, 0.9, 0.999, 1.0 };
+    vector<SteadyState> states;
+    for (double u : fractions) {
+        for (double v : fractions) {
+            double x = u * b.F, y = v * b.S;
+            if (!newton(b, x, y))
+                continue;
+            bool known = false;
+            for (const SteadyState& s : states)
+                known = known || (fabs(s.Af - x) <= 1e-6 * b.F && fabs(s.As - y) <= 1e-6 * b.S);
+            if (known)
+                continue;
+
+            SteadyState s;
+            s.Af = x;
+            s.As = y;
+            const double norm = phi_O * (b.S + b.F);
+            s.gamma_ER  = 2 * b.r4 * y * b.S / norm;
+            s.gamma_LHS = 2 * b.r6 * y * x * b.S / norm;
+            s.gamma_LHF = 2 * b.r7 * x * x * b.F / norm;
+            s.gamma_total = s.gamma_ER + s.gamma_LHS + s.gamma_LHF;
+
+            double J[2][2];
+            b.jacobian(x, y, J);
+            const double trace = J[0][0] + J[1][1];
+            const double det = J[0][0] * J[1][1] - J[0][1] * J[1][0];
+            s.stable = trace < 0.0 && det > 0.0;
+            states.push_back(s);
+        }
+    }
+    sort(states.begin(), states.end(),
+         [](const SteadyState& a, const SteadyState& c) { return a.Af < c.Af; });
+    return states;
+}
@@ -1,14 +1,64 @@
 #include "Recombination_RK.h"
 #include "Recombination_MC_real.h"
+#include "Recombination_Lattice.h"
+#include "Recombination_SteadyState.h"
+#include "CommandLine.h"
+#include "Ensemble.h"
+#include "Sweep.h"
+#include "RunReport.h"
 
 #include <fstream>
 #include <ostream>
 #include <iostream>
+#include <cmath>
+#include <string>
+#include <map>
+#include <algorithm>
 
 using namespace std;
 
-int main()
+int main(int argc, char* argv[])
 {
+    vector<string> args;
+    map<string, string> options = extractOptions(argc, argv, args);
+
+    // Console: --quiet (nothing but errors), --progress=bar|machine|off.
+    RunOptions stream;
+    if (!parseConsoleOptions(options, stream))
+        return 1;
+    const bool verbose = stream.verbose;
+
+    // Random stream: --seed=<n>; a drawn seed is printed so the run can be replayed.
+    if (parseStreamOptions(options, stream) && verbose)
+        cout << "Random seed: " << stream.seed << " (replay with --seed=" << stream.seed << ")" << endl;
+
+    // Convergence stop: --precision=<relative 95% half-width of gamma_total>,
+    // --steady-state to stop as soon as gamma_total is stationary.
+    if (options.count("precision"))
+        stream.precision = stod(options["precision"]);
+    stream.stopAtSteadyState = options.count("steady-state") > 0;
+
+    // --lattice: the Monte Carlo runs below use the lattice kinetic Monte
+    // Carlo engine (sites on a periodic square lattice) instead of the
+    // well-mixed one, with Af hops --hop-factor=<m> times faster than tau_d.
+    const bool lattice = options.count("lattice") > 0;
+    const double hopFactor = options.count("hop-factor") ? stod(options["hop-factor"]) : 1.0;
+    if (lattice && (options.count("checkpoint-every") || options.count("resume"))) {
+        cerr << "--checkpoint-every and --resume are not supported with --lattice." << endl;
+        return 1;
+    }
+    auto monteCarlo = [lattice, hopFactor](auto&&... parameters) {
+        return lattice ? LatticeRecombination(parameters..., hopFactor) : MonteCarloRecombinationReal(parameters...);
+    };
+
+    // Checkpoints of the single run (Real_Test_MC.txt): --checkpoint-every=<s>
+    // saves it to Real_Test_MC.checkpoint every s seconds of wall time,
+    // --resume continues it. The sweeps before it are run again.
+    RunOptions single = stream;
+    if (!parseCheckpointOptions(options, args, "Real_Test_MC.txt", single))
+        return 1;
+    if (single.resumeFrom && verbose)
+        cout << "Resuming from " << single.checkpointFilename << " (seed " << single.seed << ")" << endl;
 
     double O         = 1e5;
     double Fv        = 1.5e5;
@@ -28,41 +78,252 @@ int main()
     double ELHF      = 17.5e3;
     double tstop     = 1e-11;
 
-    ofstream outFile("recomb_prob.txt");
-    if (!outFile) {
-        cerr << "Error opening recomb_prob.txt for writing." << endl;
-        return 1;
+    // Ensemble: --ensemble=<replicas> runs of the Tw case on --threads=<n>
+    // workers (default: one per core), summarised on a grid of tstop/1000.
+    if (options.count("ensemble")) {
+        const size_t replicas = stoul(options["ensemble"]);
+        const size_t threads = options.count("threads") ? stoul(options["threads"]) : 0;
+
+        RunOptions run = stream;
+        run.sampling = SamplingPolicy::fixedInterval(tstop / 1000.0);
+        run.verbose = false;
+
+        vector<double> gridTimes = { 0.0 };
+        TrajectorySampler probe(run.sampling);
+        double t_grid;
+        while (probe.gridPointUpTo(tstop, t_grid))
+            gridTimes.push_back(t_grid);
+
+        TrajectoryHeader header = monteCarloRealHeader();
+        vector<string> valueNames(header.columns.begin() + 1, header.columns.end());
+        const vector<string> gammaNames = { "gamma_ER", "gamma_LHS", "gamma_LHF", "gamma_total" };
+        EnsembleStatistics grid(gridTimes.size(), valueNames.size());
+        EnsembleStatistics gammas(1, gammaNames.size());
+
+        runEnsemble(replicas, threads, grid, gammas,
+            [&](size_t replica, TrajectorySink& sink) {
+                RunOptions replicaRun = run;
+                replicaRun.replica = replica;
+                vector<double> result = monteCarlo(
+                    O, Fv, Sv, A2,
+                    M, Tg, Tw,
+                    k1, k3, k4, vd,
+                    vD, Ed, ED, Er, ELHF,
+                    tstop, sink, replicaRun);
+                return vector<double>(result.begin() + 1, result.begin() + 5);
+            });
+
+        grid.writeTable("ensemble_MC.txt", "Time", gridTimes, valueNames);
+        gammas.writeTable("ensemble_recomb_prob.txt", "Tw", { Tw }, gammaNames);
+        if (verbose) {
+            for (size_t i = 0; i < gammaNames.size(); i++) {
+                const RunningStats& s = gammas.stats(0, i);
+                cout << gammaNames[i] << "\t" << s.mean << " +- " << sqrt(s.variance()) << "\n";
+            }
+            cout << "Ensemble of " << replicas << " runs complete. Results written to "
+                 << "ensemble_MC.txt and ensemble_recomb_prob.txt" << endl;
+        }
+        return 0;
     }
-    // Write header line.
-    outFile << "Tw\tgamma_ER\tgamma_LHS\tgamma_LHF\tgamma_total\n";
-
-    int numRuns = 10;
-    double Tw_start = 200;
-    double Tw_end = 400;
-    double dTw = (Tw_end - Tw_start) / (numRuns - 1);
-
-    for (int i = 0; i < numRuns; i++) {
-        double Tw = Tw_start + i * dTw;
-        // Run the simulation for this Tw value.
-        vector<double> result = MonteCarloRecombinationReal(
-            O, Fv, Sv, A2,
-        M, Tg, Tw,
-        k1, k3, k4, vd,
-        vD, Ed, ED, Er, ELHF,
-        tstop, "extra.txt");
-        // Write a line: Tw, gamma_ER, gamma_LHS, gamma_LHF, gamma_total.
-        outFile << result[0] << "\t" << result[1] << "\t" << result[2] << "\t" 
-                << result[3] << "\t" << result[4] << "\n";
+
+    // Sweep of the recombination probabilities. Each parameter can be given as
+    // --<name>=v, --<name>=a,b,c or --<name>=lo:hi:n (Tw defaults to 200:400:10);
+    // the grid over all given parameters is run on --threads=<n> workers.
+    // --lhs=<n> instead draws n Latin-hypercube points over the lo:hi ranges.
+    // --sweep-trajectories also writes each point's trajectory to sweep_<i>.txt,
+    // and --replay=<i> reruns only point i (same seed) with its trajectory.
+    const vector<string> sweepNames = { "Tw", "Tg", "Ed", "ED", "Er", "ELHF", "O", "Fv", "Sv" };
+    if (!options.count("Tw"))
+        options["Tw"] = "200:400:10";
+
+    SweepDesign design;
+    if (options.count("lhs")) {
+        vector<SweepRange> ranges;
+        for (auto &name : sweepNames) {
+            if (!options.count(name))
+                continue;
+            SweepAxis axis = parseSweepAxis(name, options[name]);
+            ranges.push_back({ name, axis.values.front(), axis.values.back() });
+        }
+        design = SweepDesign::latinHypercube(ranges, stoul(options["lhs"]), stream.seed);
+    } else {
+        vector<SweepAxis> axes;
+        for (auto &name : sweepNames) {
+            if (options.count(name))
+                axes.push_back(parseSweepAxis(name, options[name]));
+        }
+        design = SweepDesign::grid(axes);
+    }
+
+    const size_t threads = options.count("threads") ? stoul(options["threads"]) : 0;
+    const bool keepTrajectories = options.count("sweep-trajectories") > 0;
+    RunOptions coarse = stream;
+    coarse.sampling = SamplingPolicy::fixedInterval(tstop / 1000.0);
+    coarse.verbose = false;
+
+    // Unswept parameters keep their defaults.
+    auto parametersOf = [&](const vector<double>& point) {
+        map<string, double> p = { { "Tw", Tw }, { "Tg", Tg }, { "Ed", Ed }, { "ED", ED },
+                                  { "Er", Er }, { "ELHF", ELHF }, { "O", O }, { "Fv", Fv },
+                                  { "Sv", Sv } };
+        for (size_t d = 0; d < point.size(); d++)
+            p[design.names[d]] = point[d];
+        return p;
+    };
+
+    // Point i always runs on stream (seed, replica, i), whatever thread it lands on.
+    auto evaluatePoint = [&](size_t index, const vector<double>& point, bool keep) {
+        map<string, double> p = parametersOf(point);
+
+        RunOptions run = coarse;
+        run.point = index;
+        vector<double> result;
+        if (keep) {
+            result = monteCarlo(
+                p["O"], p["Fv"], p["Sv"], A2,
+                M, p["Tg"], p["Tw"],
+                k1, k3, k4, vd,
+                vD, p["Ed"], p["ED"], p["Er"], p["ELHF"],
+                tstop, "sweep_" + to_string(index) + ".txt", run);
+        } else {
+            NullTrajectorySink discard;
+            result = monteCarlo(
+                p["O"], p["Fv"], p["Sv"], A2,
+                M, p["Tg"], p["Tw"],
+                k1, k3, k4, vd,
+                vD, p["Ed"], p["ED"], p["Er"], p["ELHF"],
+                tstop, discard, run);
+        }
+        // The gammas, their 95% half-widths, <Af>, <As> and the time reached.
+        return vector<double>(result.begin() + 1, result.end());
+    };
+
+    if (options.count("replay")) {
+        const size_t index = stoul(options["replay"]);
+        if (index >= design.points.size()) {
+            cerr << "Sweep point " << index << " does not exist." << endl;
+            return 1;
+        }
+        vector<double> gammas = evaluatePoint(index, design.points[index], true);
+        if (verbose)
+            cout << "gamma_ER\tgamma_LHS\tgamma_LHF\tgamma_total\n"
+                 << gammas[0] << "\t" << gammas[1] << "\t" << gammas[2] << "\t" << gammas[3] << "\n"
+                 << "+- " << gammas[4] << "\t+- " << gammas[5] << "\t+- " << gammas[6] << "\t+- " << gammas[7] << "\n"
+                 << "Trajectory written to sweep_" << index << ".txt" << endl;
+        return 0;
+    }
+
+    // --sweep-ode: the same design from the deterministic model instead, all
+    // points integrated together by the batched RK4 (steps of tstop/10000 up
+    // to --rk-tstop), written to recomb_prob_RK.txt.
+    const double rkStop = options.count("rk-tstop") ? stod(options["rk-tstop"]) : tstop;
+    if (options.count("sweep-ode")) {
+        vector<RecombinationPoint> batch;
+        for (auto &point : design.points) {
+            map<string, double> p = parametersOf(point);
+            batch.push_back({ p["O"], p["Fv"], p["Sv"],
+                              p["Tw"], p["Tg"], p["Ed"], p["ED"], p["Er"], p["ELHF"] });
+        }
+        vector<RecombinationResult> results = RungeKuttaRecombinationBatch(
+            batch, M, k1, vd, k3, k4, vD, tstop / 10000.0, rkStop);
+
+        bool written = runSweep(design, 1, "recomb_prob_RK.txt",
+            { "gamma_ER", "gamma_LHS", "gamma_LHF", "gamma_total", "Af", "As" },
+            [&](size_t index, const vector<double>&) {
+                const RecombinationResult& r = results[index];
+                return vector<double>{ r.gamma_ER, r.gamma_LHS, r.gamma_LHF, r.gamma_total, r.Af, r.As };
+            });
+        if (!written)
+            return 1;
+        if (verbose)
+            cout << "Deterministic sweep of " << batch.size() << " points complete. "
+                 << "Results written to recomb_prob_RK.txt" << endl;
+        return 0;
     }
-    outFile.close();
-    cout << "Simulation complete. Results written to recomb_prob.txt" << endl;
 
-    MonteCarloRecombinationReal(
+    // --sweep-steady: the steady state of the deterministic model at each point,
+    // solved directly with the gas phase held at O, written to
+    // recomb_prob_steady.txt. Points with several steady states report the
+    // first stable one and are listed on the terminal.
+    if (options.count("sweep-steady")) {
+        bool written = runSweep(design, threads, "recomb_prob_steady.txt",
+            { "gamma_ER", "gamma_LHS", "gamma_LHF", "gamma_total", "Af", "As",
+              "n_steady_states", "stable" },
+            [&](size_t index, const vector<double>& point) {
+                map<string, double> p = parametersOf(point);
+                vector<SteadyState> states = SteadyStateRecombination(
+                    p["O"], p["Fv"], p["Sv"],
+                    M, p["Tg"], p["Tw"],
+                    k1, vd, p["Ed"],
+                    k3, k4, p["Er"], p["ELHF"],
+                    vD, p["ED"]);
+                if (states.empty())
+                    return vector<double>(8, NAN);
+                auto chosen = find_if(states.begin(), states.end(),
+                                      [](const SteadyState& s) { return s.stable; });
+                if (chosen == states.end())
+                    chosen = states.begin();
+                if (states.size() > 1 || !chosen->stable)
+                    cerr << "Point " << index << ": " << states.size() << " steady states, "
+                         << (chosen->stable ? "" : "none ") << "stable\n";
+                return vector<double>{ chosen->gamma_ER, chosen->gamma_LHS, chosen->gamma_LHF,
+                                       chosen->gamma_total, chosen->Af, chosen->As,
+                                       static_cast<double>(states.size()),
+                                       chosen->stable ? 1.0 : 0.0 };
+            });
+        if (!written)
+            return 1;
+        if (verbose)
+            cout << "Steady states of " << design.points.size() << " points complete. "
+                 << "Results written to recomb_prob_steady.txt" << endl;
+        return 0;
+    }
+
+    bool swept = runSweep(design, threads, "recomb_prob.txt",
+        { "gamma_ER", "gamma_LHS", "gamma_LHF", "gamma_total",
+          "gamma_ER_ci95", "gamma_LHS_ci95", "gamma_LHF_ci95", "gamma_total_ci95",
+          "Af_mean", "As_mean", "t_end" },
+        [&](size_t index, const vector<double>& point) {
+            return evaluatePoint(index, point, keepTrajectories);
+        });
+    if (!swept)
+        return 1;
+    if (verbose)
+        cout << "Simulation complete. Results written to recomb_prob.txt" << endl;
+
+    // --report: performance summaries next to the outputs (Real_Test_MC.report.json,
+    // Real_Test_RK.report.json).
+    const bool report = options.count("report") > 0;
+    if (report)
+        single.reportFilename = reportFilenameFor("Real_Test_MC.txt");
+    monteCarlo(
         O, Fv, Sv, A2,
         M, Tg, Tw,
         k1, k3, k4, vd,
         vD, Ed, ED, Er, ELHF,
-        tstop, "Real_Test_MC.txt");
+        tstop, "Real_Test_MC.txt", single);
+
+    // Deterministic solution: --ode=ros23 (stiff Rosenbrock, default), dp45
+    // (adaptive Dormand-Prince) or rk4 (fixed steps of tstop/10000), tolerances
+    // --rtol / --atol, horizon --rk-tstop (default tstop). Written on a grid of
+    // 10000 points.
+    OdeSettings ode;
+    ode.verbose = verbose;
+    if (report)
+        ode.reportFilename = reportFilenameFor("Real_Test_RK.txt");
+    const string odeMethod = options.count("ode") ? options["ode"] : "ros23";
+    if (odeMethod == "ros23") {
+        ode.method = OdeMethod::Rosenbrock23;
+    } else if (odeMethod == "dp45") {
+        ode.method = OdeMethod::DormandPrince45;
+    } else if (odeMethod != "rk4") {
+        cerr << "Unknown ODE method: " << odeMethod << endl;
+        return 1;
+    }
+    if (options.count("rtol"))
+        ode.tolerances.rtol = stod(options["rtol"]);
+    if (options.count("atol"))
+        ode.tolerances.atol = stod(options["atol"]);
 
     RungeKuttaRecombination(O, Fv, 0.0,
         Sv, 0.0,  A2,
@@ -70,8 +331,8 @@ int main()
         k1,  vd, Ed,
         k3, k4, Er, ELHF,
         vD, ED,
-        tstop/10000.0, tstop,
-        "Real_Test_RK.txt");
+        tstop/10000.0, rkStop,
+        "Real_Test_RK.txt", SamplingPolicy::fixedInterval(rkStop / 10000.0), ode);
 
     return 0;
 }
@@ -1,4 +1,10 @@
 #include "Plasma-Surface-Recombination.h"
+#include "TrajectoryWriter.h"
+#include "ReactionSelection.h"
+#include "Random.h"
+#include "RunReport.h"
+#include "Progress.h"
+#include "Checkpoint.h"
 #include <iostream>
 #include <vector>
 #include <random>
@@ -6,9 +12,9 @@
 #include <fstream>
 #include <string>
 #include <cstdlib>
-#include <functional>
 #include <map>
 #include <algorithm>
+#include <limits>
 #include <set>
 #include <stdio.h>
 
@@ -18,16 +24,39 @@
 
 using namespace std;
 
-// Global variables (defined in the Plasma-Surface-Recombination.cpp file)
-extern double initial_A;
-extern double global_Tw;
-extern double global_Tg;
-extern double global_M;
-extern bool general_params_extracted;
-extern double vD;
-extern double ED;
-extern double Er;
-extern double k_4;
+// Global variable for initial concentration of A.
+double initial_A = 0.0;
+
+// Global general parameters (for non‑Basic reactions).
+double global_Tw = 0.0, global_Tg = 0.0, global_M = 0.0;
+bool general_params_extracted = false;
+
+double vD;
+double ED;
+double Er;
+double k_4;
+double vD_sd;
+double ED_sd;
+double Er_ch;
+double k4_ch; 
+
+// This map specifies what type of species each reaction needs
+static const map<string, vector<string>> reactionSpecies = {
+    {"Basic", {"A", "B"}},
+    {"Physisorption", {"A", "Fv", "Af"}},
+    {"Chemisorption", {"A", "Sv", "As", "A2"}},
+    {"Surface Diffusion", {"Af", "Sv", "Fv", "As"}},
+    {"Langmuir-Hinshelwood recombination", {"Af", "As", "Fv", "Sv", "A2"}}
+};
+
+// This map specifies how many parameters each reaction requires
+static const map<string, int> reactionRateCount = {
+    {"Basic", 2},
+    {"Physisorption", 3},
+    {"Chemisorption", 3},
+    {"Surface Diffusion", 2},
+    {"Langmuir-Hinshelwood recombination", 5}
+};
 
 
 vector<ReactionEvent> buildEventsForReaction(const string& reaction, 
@@ -47,21 +76,15 @@ vector<ReactionEvent> buildEventsForReaction(const string& reaction,
         double kA = rates[rateIndex++];
         double kB = rates[rateIndex++];
         {
-            ReactionEvent e;
+            ReactionEvent e = prop_single(idx("A"));
             e.k = kA;
-            e.propensity = prop_single(idx("A"));
-            e.delta.resize(speciesIndex.size(), 0.0);
-            e.delta[idx("A")] = -1.0;
-            e.delta[idx("B")] = +1.0;
+            e.stoich = { {idx("A"), -1}, {idx("B"), +1} };
             result.push_back(e);
         }
         {
-            ReactionEvent e;
+            ReactionEvent e = prop_single(idx("B"));
             e.k = kB;
-            e.propensity = prop_single(idx("B"));
-            e.delta.resize(speciesIndex.size(), 0.0);
-            e.delta[idx("B")] = -1.0;
-            e.delta[idx("A")] = +1.0;
+            e.stoich = { {idx("B"), -1}, {idx("A"), +1} };
             result.push_back(e);
         }
     }
@@ -82,23 +105,15 @@ vector<ReactionEvent> buildEventsForReaction(const string& reaction,
             double vd  = rates[rateIndex++];
             double Ed  = rates[rateIndex++];
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_bimolecular(idx("A"), idx("Fv"));
                 e.k = k_1 * phi_O;
-                e.propensity = prop_bimolecular(idx("A"), idx("Fv"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("A")]  = -1.0;
-                e.delta[idx("Fv")] = -1.0;
-                e.delta[idx("Af")] = +1.0;
+                e.stoich = { {idx("A"), -1}, {idx("Fv"), -1}, {idx("Af"), +1} };
                 result.push_back(e);
             }
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_single(idx("Af"));
                 e.k = vd * std::exp(-Ed / (Na * kb * global_Tw));
-                e.propensity = prop_single(idx("Af"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("Af")] = -1.0;
-                e.delta[idx("A")]  = +1.0;
-                e.delta[idx("Fv")] = +1.0;
+                e.stoich = { {idx("Af"), -1}, {idx("A"), +1}, {idx("Fv"), +1} };
                 result.push_back(e);
             }
         }
@@ -109,24 +124,15 @@ vector<ReactionEvent> buildEventsForReaction(const string& reaction,
             Er  = rates[rateIndex++];
             double Pr  = k_4 * std::exp(-Er / (Na * kb * global_Tw));
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_bimolecular(idx("A"), idx("Sv"));
                 e.k = k_3 * phi_O;
-                e.propensity = prop_bimolecular(idx("A"), idx("Sv"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("A")]  = -1.0;
-                e.delta[idx("Sv")] = -1.0;
-                e.delta[idx("As")] = +1.0;
+                e.stoich = { {idx("A"), -1}, {idx("Sv"), -1}, {idx("As"), +1} };
                 result.push_back(e);
             }
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_bimolecular(idx("A"), idx("As"));
                 e.k = Pr * k_3 * phi_O;
-                e.propensity = prop_bimolecular(idx("A"), idx("As"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("A")]  = -1.0;
-                e.delta[idx("As")] = -1.0;
-                e.delta[idx("A2")] = +1.0;
-                e.delta[idx("Sv")] = +1.0;
+                e.stoich = { {idx("A"), -1}, {idx("As"), -1}, {idx("A2"), +1}, {idx("Sv"), +1} };
                 result.push_back(e);
             }
         }
@@ -136,14 +142,9 @@ vector<ReactionEvent> buildEventsForReaction(const string& reaction,
             ED = rates[rateIndex++];
             double tau_d_1 = vD * std::exp(-ED / (Na * kb * global_Tw));
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_bimolecular(idx("Af"), idx("Sv"));
                 e.k = 0.75 * tau_d_1;
-                e.propensity = prop_bimolecular(idx("Af"), idx("Sv"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("Af")] = -1.0;
-                e.delta[idx("Sv")] = -1.0;
-                e.delta[idx("Fv")] = +1.0;
-                e.delta[idx("As")] = +1.0;
+                e.stoich = { {idx("Af"), -1}, {idx("Sv"), -1}, {idx("Fv"), +1}, {idx("As"), +1} };
                 result.push_back(e);
             }
         }
@@ -182,25 +183,15 @@ vector<ReactionEvent> buildEventsForReaction(const string& reaction,
             double Pr   = k4_local * std::exp(-Er_local / (Na * kb * global_Tw));
             double Prlh = k4_local * std::exp(-ELHF_local / (Na * kb * global_Tw));
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_bimolecular(idx("Af"), idx("As"));
                 e.k = tau_d_1 * Pr;
-                e.propensity = prop_bimolecular(idx("Af"), idx("As"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("Af")] = -1.0;
-                e.delta[idx("As")] = -1.0;
-                e.delta[idx("A2")] = +1.0;
-                e.delta[idx("Sv")] = +1.0;
-                e.delta[idx("Fv")] = +1.0;
+                e.stoich = { {idx("Af"), -1}, {idx("As"), -1}, {idx("A2"), +1}, {idx("Sv"), +1}, {idx("Fv"), +1} };
                 result.push_back(e);
             }
             {
-                ReactionEvent e;
+                ReactionEvent e = prop_square(idx("Af"));
                 e.k = tau_d_1 * Prlh;
-                e.propensity = prop_square(idx("Af"));
-                e.delta.resize(speciesIndex.size(), 0.0);
-                e.delta[idx("Af")] = -2.0;
-                e.delta[idx("A2")] = +1.0;
-                e.delta[idx("Fv")] = +2.0;
+                e.stoich = { {idx("Af"), -2}, {idx("A2"), +1}, {idx("Fv"), +2} };
                 result.push_back(e);
             }
         }
@@ -209,127 +200,448 @@ vector<ReactionEvent> buildEventsForReaction(const string& reaction,
 }
 
 
-// Function that generates a progress bar.
-void printProgressBar(double progress, double total) 
+// Writes a reaction as text from its stoichiometry, e.g. "2 Af -> A2 + 2 Fv".
+string describeReaction(const ReactionEvent& event, const vector<string>& speciesList)
 {
-   int barWidth = 50;
-   float percent = static_cast<float>(progress) / total;
-   int filled = percent * barWidth;
- 
-   std::cout << "\r[";
-   for (int i = 0; i <= barWidth; i++) {
-       if (i < filled)
-           std::cout << "=";
-       else if (i == filled)
-           std::cout << ">";
-       else
-           std::cout << " ";
-   }
-   std::cout << "] " << int(percent * 100.0) << "%" << std::flush;
+    string lhs, rhs;
+    for (auto &entry : event.stoich) {
+        if (entry.second == 0 || entry.first >= static_cast<int>(speciesList.size()))
+            continue;
+        string& side = (entry.second < 0) ? lhs : rhs;
+        int n = abs(entry.second);
+        if (!side.empty())
+            side += " + ";
+        if (n != 1)
+            side += to_string(n) + " ";
+        side += speciesList[entry.first];
+    }
+    return lhs + " -> " + rhs;
 }
 
 
-// Function that runs the Monte Carlo simulation, storing both the populations
-// and the instantaneous propensities (Big R values) at each time step.
-void simulateMultiReaction(double t_stop, 
-                           const vector<ReactionEvent>& events, 
-                           vector<double>& state,
-                           const vector<string>& speciesList,
-                           const string& outputFilename)
+bool parseReactionNetwork(const vector<string>& args, ReactionNetwork& network, string& error)
 {
-    double t = 0.0;
-    vector<double> times { t };
-    vector<vector<double>> states { state };
-    vector<vector<double>> propHistory; // To store propensities for each event at each time step.
-    
-    random_device rd;
-    mt19937 gen(rd());
-    uniform_real_distribution<> dis(0.0, 1.0);
+    const int nArgs = static_cast<int>(args.size());
+    network = ReactionNetwork();
+    vector<string>& reactions = network.reactions;
 
-    printProgressBar(0.0, t_stop);
+    // Parse reaction names until a numeric token is encountered.
+    int argIndex = 0;
+    while (argIndex < nArgs) {
+        string token = args[argIndex];
+        try {
+            stod(token);
+            break;
+        } catch (...) {
+            reactions.push_back(token);
+            argIndex++;
+        }
+    }
+    if (reactions.empty()) {
+        error = "No reactions specified.";
+        return false;
+    }
 
-    while (t < t_stop) {
-        double total_rate = 0.0;
-        vector<double> rvec;
-        rvec.reserve(events.size());
-        for (auto &evt : events) {
-            double r = evt.propensity(state, evt.k);
-            rvec.push_back(r);
-            total_rate += r;
+    // Compute nominal needed rate constants.
+    int neededRateConstants = 0;
+    for (auto &r : reactions) {
+        auto it = reactionRateCount.find(r);
+        if (it == reactionRateCount.end()) {
+            error = "Unknown reaction: " + r;
+            return false;
+        }
+        neededRateConstants += it->second;
+    }
+    const bool chemPresent = (find(reactions.begin(), reactions.end(), "Chemisorption") != reactions.end());
+    const bool surfPresent = (find(reactions.begin(), reactions.end(), "Surface Diffusion") != reactions.end());
+    // Adjust for Langmuir-Hinshelwood recombination if shared.
+    if (find(reactions.begin(), reactions.end(), "Langmuir-Hinshelwood recombination") != reactions.end()) {
+        if (chemPresent && surfPresent) {
+            neededRateConstants = neededRateConstants - reactionRateCount.at("Langmuir-Hinshelwood recombination") + 1;
+        } else if (chemPresent || surfPresent) {
+            neededRateConstants = neededRateConstants - reactionRateCount.at("Langmuir-Hinshelwood recombination") + 3;
         }
+    }
 
-        if (total_rate <= 1e-15)
-            break;
+    // Build union of species.
+    set<string> usedSpecies;
+    for (auto &r : reactions) {
+        for (auto &s : reactionSpecies.at(r))
+            usedSpecies.insert(s);
+    }
+    vector<string> fixedOrder = {"A", "B", "Af", "As", "Fv", "Sv", "A2"};
+    for (const auto &s : fixedOrder) {
+        if (usedSpecies.find(s) != usedSpecies.end())
+            network.species.push_back(s);
+    }
+    const int nSpecies = static_cast<int>(network.species.size());
 
-        double r1 = dis(gen);
-        double dt = -log(r1) / total_rate;
-        t += dt;
-        if (t > t_stop)
-            break;
+    const bool basic = (reactions.size() == 1 && reactions[0] == "Basic");
+    int totalNumericNeeded = basic ? (2 + nSpecies + 1) : (3 + neededRateConstants + nSpecies + 1);
+    int numericAvailable = nArgs - argIndex;
+    if (numericAvailable < totalNumericNeeded) {
+        error = "Not enough numeric parameters provided. Expected " + to_string(totalNumericNeeded)
+              + ", got " + to_string(numericAvailable) + ".";
+        return false;
+    }
+
+    vector<double> rates;
+    try {
+        const int nRates = basic ? 2 : 3 + neededRateConstants; // General parameters: Tw, Tg, M.
+        for (int i = 0; i < nRates; i++)
+            rates.push_back(stod(args[argIndex++]));
+        for (int i = 0; i < nSpecies; i++)
+            network.initialState.push_back(stod(args[argIndex++]));
+        network.t_stop = stod(args[argIndex++]);
+    } catch (...) {
+        error = "Invalid numeric parameter: " + args[argIndex - 1];
+        return false;
+    }
 
-        double r2 = dis(gen) * total_rate;
-        double cum = 0.0;
-        int chosen = -1;
-        for (int i = 0; i < static_cast<int>(events.size()); i++) {
-            cum += rvec[i];
-            if (cum >= r2) {
-                chosen = i;
-                break;
+    // Build mapping from species name to index.
+    for (int i = 0; i < nSpecies; i++)
+        network.speciesIndex[network.species[i]] = i;
+
+    if (network.speciesIndex.find("A") == network.speciesIndex.end()) {
+        error = "Species A is not in the union; cannot define initial_A.";
+        return false;
+    }
+    initial_A = network.initialState[network.speciesIndex["A"]];
+    general_params_extracted = false;
+
+    int ratePos = 0;
+    for (auto &r : reactions) {
+        vector<ReactionEvent> these = buildEventsForReaction(r, rates, ratePos, network.speciesIndex,
+                                                             chemPresent, surfPresent);
+        network.events.insert(network.events.end(), these.begin(), these.end());
+    }
+    return true;
+}
+
+EngineFunction engineByName(const string& name)
+{
+    if (name == "direct")
+        return simulateMultiReaction;
+    if (name == "nrm")
+        return simulateNextReaction;
+    if (name == "tau")
+        return simulateTauLeaping;
+    if (name == "ode")
+        return simulateMeanField;
+    return nullptr;
+}
+
+bool parseSimulationOptions(const map<string, string>& options, const ReactionNetwork& network,
+                            SimulationOptions& simOptions, string& error)
+{
+    auto option = [&](const char* name) { return options.find(name); };
+    try {
+        // Output sampling: --sample-dt=<s>, --sample-every=<n> or --sample-on=<species>.
+        SamplingPolicy& sampling = simOptions.sampling;
+        if (option("sample-dt") != options.end()) {
+            sampling = SamplingPolicy::fixedInterval(stod(option("sample-dt")->second));
+        } else if (option("sample-every") != options.end()) {
+            sampling = SamplingPolicy::everyNEvents(stoll(option("sample-every")->second));
+        } else if (option("sample-on") != options.end()) {
+            auto it = network.speciesIndex.find(option("sample-on")->second);
+            if (it == network.speciesIndex.end()) {
+                error = "Unknown species for --sample-on: " + option("sample-on")->second;
+                return false;
             }
+            sampling = SamplingPolicy::onChange(it->second);
         }
-        if (chosen < 0)
-            break;
-        
-        for (int i = 0; i < static_cast<int>(state.size()); i++) {
-            state[i] += events[chosen].delta[i];
-            if (state[i] < 0)
-                state[i] = 0;
+
+        // Reaction selection of the direct method: --selector=linear (default), tree or cr.
+        string selector = option("selector") != options.end() ? option("selector")->second : "linear";
+        if (selector == "tree") {
+            simOptions.selection = SelectionMethod::SumTree;
+        } else if (selector == "cr") {
+            simOptions.selection = SelectionMethod::CompositionRejection;
+        } else if (selector != "linear") {
+            error = "Unknown selector: " + selector;
+            return false;
         }
 
-        times.push_back(t);
-        states.push_back(state);
-        propHistory.push_back(rvec);  // Store the propensities computed at this time step.
+        // Tau-leaping accuracy: --tau-eps=<relative change per leap>.
+        if (option("tau-eps") != options.end())
+            simOptions.tauEpsilon = stod(option("tau-eps")->second);
 
-        printProgressBar(t, t_stop);
+        // Mean-field accuracy: --rtol=<relative>, --atol=<absolute> error per step.
+        if (option("rtol") != options.end())
+            simOptions.odeTolerances.rtol = stod(option("rtol")->second);
+        if (option("atol") != options.end())
+            simOptions.odeTolerances.atol = stod(option("atol")->second);
+    } catch (const exception&) {
+        error = "Invalid numeric option value.";
+        return false;
     }
-    cout << "\n";
+    return true;
+}
 
-    ofstream outFile(outputFilename);
-    if (!outFile) {
-        cerr << "Error opening file: " << outputFilename << "\n";
-        return;
-    }
-    // Write header: time, populations, then propensities.
-    outFile << "Time";
-    for (auto &s : speciesList) {
-        outFile << "\tPopulation " << s;
+ReactionTable compileReactionTable(const vector<ReactionEvent>& events, size_t nSpecies,
+                                   bool integerCounts)
+{
+    ReactionTable table;
+    table.nSpecies = nSpecies;
+    table.nReactions = events.size();
+    const int one = static_cast<int>(nSpecies);  // padded entry fixed at 1
+    table.stoichStart.push_back(0);
+    for (auto &e : events) {
+        table.order.push_back(e.order);
+        table.reactant1.push_back(e.reactant1);
+        table.reactant2.push_back(e.order >= 2 ? e.reactant2 : one);
+        table.k.push_back(e.k);
+        const bool square = e.order >= 2 && e.reactant1 == e.reactant2;
+        table.minReactant.push_back(!integerCounts ? -numeric_limits<double>::infinity() : square ? 2.0 : 0.0);
+        for (auto &entry : e.stoich) {
+            if (entry.second == 0)
+                continue;
+            table.stoichSpecies.push_back(entry.first);
+            table.stoichChange.push_back(entry.second);
+        }
+        table.stoichStart.push_back(static_cast<int>(table.stoichSpecies.size()));
     }
-    for (size_t i = 0; i < events.size(); i++) {
-        outFile << "\tR" << i+1;
+    return table;
+}
+
+vector<int64_t> wholeCounts(const vector<double>& state)
+{
+    vector<int64_t> n(state.size());
+    for (size_t i = 0; i < state.size(); i++)
+        n[i] = static_cast<int64_t>(llround(max(state[i], 0.0)));
+    return n;
+}
+
+vector<double> paddedState(const vector<int64_t>& n)
+{
+    vector<double> x(n.size() + 1, 1.0);
+    for (size_t i = 0; i < n.size(); i++)
+        x[i] = static_cast<double>(n[i]);
+    return x;
+}
+
+
+// Direct-method loop shared by all selection backends. Non-incremental
+// selectors recompute every propensity per event; incremental ones only
+// update the reactions that depend on the fired one.
+//
+// With run.checkpointInterval the loop state (populations, propensities,
+// time, selector, random stream position, sampler, firings) and the sink's
+// position are checkpointed between events; with run.resumeFrom the loop
+// starts from such a checkpoint. Returns -1 if it cannot be resumed.
+template <typename Selector, typename Record>
+static double runDirectMethod(double t_stop, const ReactionTable& table,
+                              vector<int64_t>& n, vector<double>& x, vector<double>& rvec,
+                              TrajectorySampler& sampler, size_t watched,
+                              const RunOptions& run, Record& record,
+                              TrajectorySink& sink, RunReport& report)
+{
+    const size_t nEvents = table.nReactions;
+    Selector selector(nEvents);
+    vector<vector<int>> dependents;
+    if (Selector::incremental) {
+        dependents = buildDependencyGraph(table);
+        selector.reset(rvec.data(), table.propensities(x.data(), rvec.data()));
     }
-    outFile << "\n";
-    
-    // Write out each time step.
-    for (size_t i = 0; i < times.size(); i++) {
-        outFile << times[i];
-        // Write species populations.
-        for (size_t j = 0; j < speciesList.size(); j++) {
-            outFile << "\t" << states[i][j];
+
+    Rng gen = makeGenerator(run);
+    auto uniform = [&]() { return gen.uniform(); };
+
+    double t = 0.0;
+    if (run.resumeFrom) {
+        const Checkpoint& checkpoint = *run.resumeFrom;
+        vector<double> savedX, savedRates, savedTime, savedSelector;
+        uint64_t position;
+        if (!checkpoint.getDoubles("direct.x", savedX) || savedX.size() != x.size() ||
+            !checkpoint.getDoubles("direct.rates", savedRates) || savedRates.size() != rvec.size() ||
+            !checkpoint.getDoubles("direct.time", savedTime) || savedTime.size() != 1 ||
+            !checkpoint.getDoubles("direct.selector", savedSelector) || !selector.restore(savedSelector) ||
+            !checkpoint.getInteger("rng.position", position) ||
+            !sampler.restoreFrom(checkpoint) || !report.restoreFrom(checkpoint)) {
+            cerr << "Cannot resume the direct method from " << run.checkpointFilename << "\n";
+            return -1.0;
         }
-        // For the initial time step, we have no propensity values.
-        if (i == 0) {
-            for (size_t k = 0; k < events.size(); k++)
-                outFile << "\t0";
-        } else {
-            int propIndex = i - 1; // propHistory is one element shorter.
-            for (size_t k = 0; k < events.size(); k++) {
-                outFile << "\t" << propHistory[propIndex][k];
+        // x holds the counts exactly.
+        x = savedX;
+        for (size_t i = 0; i < n.size(); i++)
+            n[i] = static_cast<int64_t>(llround(x[i]));
+        rvec = savedRates;
+        t = savedTime[0];
+        gen.seek(position);
+    }
+
+    CheckpointSchedule checkpoints(run.checkpointFilename.empty() ? 0.0 : run.checkpointInterval);
+    auto saveCheckpoint = [&]() {
+        Checkpoint checkpoint = checkpointOf(run);
+        checkpoint.putDoubles("direct.x", x);
+        checkpoint.putDoubles("direct.rates", rvec);
+        checkpoint.putDoubles("direct.time", { t });
+        checkpoint.putDoubles("direct.selector", selector.state());
+        checkpoint.putInteger("rng.position", gen.position());
+        sampler.saveTo(checkpoint);
+        report.saveTo(checkpoint);
+        if (!sink.saveTo(checkpoint) || !checkpoint.save(run.checkpointFilename))
+            cerr << "Cannot write the checkpoint " << run.checkpointFilename << "\n";
+    };
+
+    ProgressReporter progress(t_stop, run);
+
+    while (t < t_stop) {
+        report.beginStep();
+        if (!Selector::incremental)
+            selector.reset(rvec.data(), table.propensities(x.data(), rvec.data()));
+        double total_rate = selector.total();
+        report.phaseDone(RunPhase::Propensities);
+
+        if (total_rate <= 1e-15)
+            break;
+
+        double dt = gen.exponential() / total_rate;
+        report.phaseDone(RunPhase::Selection);
+
+        // On a fixed output grid the state is piecewise constant between events.
+        double t_grid;
+        while (sampler.gridPointBefore(min(t + dt, t_stop), t_grid))
+            record(t_grid);
+        report.phaseDone(RunPhase::Output);
+
+        t += dt;
+        if (t > t_stop)
+            break;
+
+        size_t chosen = selector.select(uniform);
+        if (chosen >= nEvents)
+            break;
+        report.phaseDone(RunPhase::Selection);
+
+        const double watchedBefore = x[watched];
+        table.fire(n.data(), x.data(), chosen);
+        report.fired(chosen);
+        report.phaseDone(RunPhase::Update);
+
+        if (sampler.recordEvent(watchedBefore, x[watched]))
+            record(t);
+        report.phaseDone(RunPhase::Output);
+
+        if (Selector::incremental) {
+            for (int j : dependents[chosen]) {
+                rvec[j] = table.propensity(x.data(), static_cast<size_t>(j));
+                selector.set(static_cast<size_t>(j), rvec[j]);
             }
         }
-        outFile << "\n";
+        report.phaseDone(RunPhase::Propensities);
+
+        progress.update(t);
+        if (checkpoints.due())
+            saveCheckpoint();
+        report.phaseDone(RunPhase::Output);
+    }
+    progress.finish(t);
+    return t;
+}
+
+
+TrajectoryHeader trajectoryHeaderFor(const vector<ReactionEvent>& events,
+                                     const vector<string>& speciesList)
+{
+    // Header: time, populations, then propensities.
+    TrajectoryHeader header;
+    header.columns.push_back("Time");
+    for (auto &s : speciesList)
+        header.columns.push_back("Population " + s);
+    for (size_t i = 0; i < events.size(); i++) {
+        header.columns.push_back("R" + to_string(i + 1));
+        header.reactions.push_back(describeReaction(events[i], speciesList));
     }
-    
-    outFile.close();
-    cout << "Simulation complete. Output written to " << outputFilename << "\n";
+    header.nSpecies = speciesList.size();
+    return header;
+}
+
+
+// Function that runs the Monte Carlo simulation, streaming the populations
+// and the instantaneous propensities (Big R values) of each time step to
+// outputFilename as they are produced.
+void simulateMultiReaction(double t_stop, 
+                           const vector<ReactionEvent>& events, 
+                           vector<double>& state,
+                           const vector<string>& speciesList,
+                           const string& outputFilename,
+                           const SimulationOptions& options)
+{
+    TrajectoryWriter writer(outputFilename, trajectoryHeaderFor(events, speciesList));
+    if (!writer.good())
+        return;
+    simulateMultiReaction(t_stop, events, state, writer, options);
+    writer.close();
+    if (options.verbose)
+        cout << "Simulation complete. Output written to " << outputFilename << "\n";
 }
 
+void simulateMultiReaction(double t_stop,
+                           const vector<ReactionEvent>& events,
+                           vector<double>& state,
+                           TrajectorySink& sink,
+                           const SimulationOptions& options)
+{
+    const SamplingPolicy& sampling = options.sampling;
+    const size_t nSpecies = state.size();
+    const size_t nEvents = events.size();
+    const ReactionTable table = compileReactionTable(events, nSpecies);
+
+    TrajectorySampler sampler(sampling);
+    const size_t watched = (sampling.species >= 0 && static_cast<size_t>(sampling.species) < nSpecies)
+                         ? static_cast<size_t>(sampling.species) : 0;
+
+    // Exact counts and their padded copy (last entry fixed at 1, see ReactionTable).
+    vector<int64_t> n = wholeCounts(state);
+    vector<double> x = paddedState(n);
+
+    vector<double> rvec(nEvents, 0.0);
+
+    // Stores the state and the propensities computed at this time step.
+    vector<double> row(1 + nSpecies + nEvents);
+    auto record = [&](double time) {
+        row[0] = time;
+        copy(x.begin(), x.begin() + nSpecies, row.begin() + 1);
+        copy(rvec.begin(), rvec.end(), row.begin() + 1 + nSpecies);
+        sink.writeRow(row.data());
+    };
+
+    // For the initial time step, we have no propensity values. A resumed run
+    // has written it already.
+    if (!options.resumeFrom)
+        record(0.0);
+
+    // Firings per reaction, named after the propensity columns.
+    vector<string> reactionNames;
+    for (size_t j = 0; j < nEvents; j++)
+        reactionNames.push_back("R" + to_string(j + 1));
+    const char* selectorNames[] = { "direct (linear)", "direct (sum tree)", "direct (composition-rejection)" };
+    RunReport report(selectorNames[static_cast<int>(options.selection)], reactionNames,
+                     !options.reportFilename.empty());
+
+    double t = 0.0;
+    switch (options.selection) {
+        case SelectionMethod::SumTree:
+            t = runDirectMethod<SumTreeSelector>(t_stop, table, n, x, rvec, sampler, watched, options, record, sink, report);
+            break;
+        case SelectionMethod::CompositionRejection:
+            t = runDirectMethod<CompositionRejectionSelector>(t_stop, table, n, x, rvec, sampler, watched, options, record, sink, report);
+            break;
+        default:
+            t = runDirectMethod<LinearSelector>(t_stop, table, n, x, rvec, sampler, watched, options, record, sink, report);
+            break;
+    }
+    if (t < 0.0)
+        return;
+    report.finish(min(t, t_stop));
+    if (!options.reportFilename.empty() && !report.writeJson(options.reportFilename))
+        cerr << "Error opening file: " << options.reportFilename << "\n";
+
+    // Remaining grid points hold the final state.
+    double t_grid;
+    while (sampler.gridPointUpTo(t_stop, t_grid))
+        record(t_grid);
+
+    copy(x.begin(), x.begin() + nSpecies, state.begin());
+}
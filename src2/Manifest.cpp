@@ -0,0 +1,327 @@
+/*
+    Batch mode: every job of a manifest file in one process, with an on-disk
+    cache of the results.
+
+    A manifest has one job per line, written as the engine's command line
+    ("Surface Diffusion" and other names with spaces in double quotes), plus
+    --output=<file> (default job_<line>.txt, or .ptraj with --binary). Empty
+    lines and lines starting with # are skipped.
+
+    Each job is described canonically: reaction set, numeric parameters (as
+    parsed, so 1e5 and 100000 agree), engine, random stream, sampling, the
+    other run settings that change the result and the output format. The
+    FNV-1a hash of that text names the cache entry, <cache>/<hash>.txt or
+    .ptraj next to <hash>.key, which holds the description so a hash
+    collision is never taken for a hit. Hits are copied to the job's output;
+    the misses run on a thread pool and are added to the cache (written to a
+    temporary name and renamed, so an interrupted run leaves no partial
+    entry). A job without --seed gets one derived from its description, so
+    re-running a manifest is reproducible and only new jobs are simulated.
+*/
+
+#include "Plasma-Surface-Recombination.h"
+#include "CommandLine.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Bump when an engine change makes cached results stale.
+static const int cacheVersion = 2;
+
+namespace {
+
+struct ManifestJob {
+    size_t line = 0;
+    ReactionNetwork network;
+    EngineFunction run = nullptr;
+    bool meanField = false;
+    SimulationOptions options;
+    string outputFilename;
+    string key;
+    string hash;
+};
+
+uint64_t fnv1a(const string& text)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+string hex(uint64_t value)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+string exact(double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.17g", value);
+    return text;
+}
+
+// Splits a manifest line into arguments; double quotes group words.
+vector<string> splitArguments(const string& line)
+{
+    vector<string> tokens;
+    string token;
+    bool quoted = false, inToken = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            inToken = true;
+        } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if (inToken)
+                tokens.push_back(token);
+            token.clear();
+            inToken = false;
+        } else {
+            token += c;
+            inToken = true;
+        }
+    }
+    if (inToken)
+        tokens.push_back(token);
+    return tokens;
+}
+
+// Everything in a job that changes its output, except the random stream.
+string describeJob(const vector<string>& args, const ManifestJob& job, const string& engine)
+{
+    ostringstream key;
+    key << "version " << cacheVersion << "\nreactions";
+    for (const string& r : job.network.reactions)
+        key << " \"" << r << "\"";
+    key << "\nparameters";
+    for (size_t i = job.network.reactions.size(); i < args.size(); i++)
+        key << " " << exact(stod(args[i]));
+    const SimulationOptions& o = job.options;
+    key << "\nengine " << engine
+        << "\nsampling " << static_cast<int>(o.sampling.mode) << " " << exact(o.sampling.interval)
+        << " " << o.sampling.everyN << " " << o.sampling.species
+        << "\nselector " << static_cast<int>(o.selection)
+        << "\ntau-eps " << exact(o.tauEpsilon)
+        << "\nrtol " << exact(o.odeTolerances.rtol) << " atol " << exact(o.odeTolerances.atol)
+        << "\nformat " << (trajectoryFormatFor(job.outputFilename) == TrajectoryFormat::Binary ? "binary" : "text")
+        << "\n";
+    return key.str();
+}
+
+bool parseJob(const vector<string>& tokens, const map<string, string>& manifestOptions,
+              ManifestJob& job, string& error)
+{
+    vector<string> args;
+    map<string, string> options = extractOptions(tokens, args);
+    if (!parseReactionNetwork(args, job.network, error) ||
+        !parseSimulationOptions(options, job.network, job.options, error))
+        return false;
+
+    const string engine = options.count("engine") ? options["engine"] : "direct";
+    job.run = engineByName(engine);
+    if (!job.run) {
+        error = "Unknown engine: " + engine;
+        return false;
+    }
+    job.meanField = (engine == "ode");
+    if (options.count("output"))
+        job.outputFilename = options["output"];
+    else
+        job.outputFilename = "job_" + to_string(job.line) + (options.count("binary") ? ".ptraj" : ".txt");
+
+    // Random stream: the job's own, else the manifest's --seed, else one
+    // derived from the job, so that every job is reproducible.
+    job.key = describeJob(args, job, engine);
+    if (!options.count("seed")) {
+        auto seed = manifestOptions.find("seed");
+        options["seed"] = seed != manifestOptions.end() ? seed->second : to_string(fnv1a(job.key));
+    }
+    parseStreamOptions(options, job.options);
+    job.key += "stream " + to_string(job.options.seed) + " " + to_string(job.options.replica) + " "
+             + to_string(job.options.point) + "\n";
+    job.hash = hex(fnv1a(job.key));
+    job.options.verbose = false;
+    return true;
+}
+
+string cachedTrajectory(const string& cacheDir, const ManifestJob& job)
+{
+    const bool binary = trajectoryFormatFor(job.outputFilename) == TrajectoryFormat::Binary;
+    return (fs::path(cacheDir) / (job.hash + (binary ? ".ptraj" : ".txt"))).string();
+}
+
+bool isCached(const string& cacheDir, const ManifestJob& job)
+{
+    ifstream keyFile(fs::path(cacheDir) / (job.hash + ".key"), ios::binary);
+    if (!keyFile || !fs::exists(cachedTrajectory(cacheDir, job)))
+        return false;
+    ostringstream stored;
+    stored << keyFile.rdbuf();
+    return stored.str() == job.key;
+}
+
+// Adds the job's output to the cache: the description, then the trajectory,
+// each written under a temporary name and renamed into place.
+void storeInCache(const string& cacheDir, const ManifestJob& job)
+{
+    error_code ec;
+    const fs::path keyPath = fs::path(cacheDir) / (job.hash + ".key");
+    const fs::path tmpKey = keyPath.string() + ".tmp";
+    {
+        ofstream out(tmpKey, ios::binary);
+        out << job.key;
+    }
+    fs::rename(tmpKey, keyPath, ec);
+
+    const fs::path dataPath = cachedTrajectory(cacheDir, job);
+    const fs::path tmpData = dataPath.string() + ".tmp";
+    fs::copy_file(job.outputFilename, tmpData, fs::copy_options::overwrite_existing, ec);
+    if (!ec)
+        fs::rename(tmpData, dataPath, ec);
+    if (ec)
+        cerr << "Could not cache " << job.outputFilename << ": " << ec.message() << "\n";
+}
+
+bool copyFile(const string& from, const string& to)
+{
+    error_code ec;
+    if (fs::equivalent(from, to, ec))
+        return true;
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+    if (ec)
+        cerr << "Could not copy " << from << " to " << to << ": " << ec.message() << "\n";
+    return !ec;
+}
+
+}
+
+int runManifest(const string& manifestFilename, const map<string, string>& options)
+{
+    ifstream manifest(manifestFilename);
+    if (!manifest) {
+        cerr << "Cannot open manifest " << manifestFilename << "\n";
+        return 1;
+    }
+    RunOptions console;
+    if (!parseConsoleOptions(options, console))
+        return 1;
+    const bool verbose = console.verbose;
+    const bool useCache = !options.count("no-cache");
+    const string cacheDir = options.count("cache") ? options.at("cache") : "psr_cache";
+    const size_t threads = options.count("threads") ? stoul(options.at("threads")) : 0;
+
+    // Jobs are parsed in order on this thread (buildEventsForReaction reads globals).
+    vector<ManifestJob> jobs;
+    int failed = 0;
+    string text;
+    for (size_t line = 1; getline(manifest, text); line++) {
+        vector<string> tokens = splitArguments(text);
+        if (tokens.empty() || tokens[0][0] == '#')
+            continue;
+        ManifestJob job;
+        job.line = line;
+        string error;
+        if (!parseJob(tokens, options, job, error)) {
+            cerr << manifestFilename << ":" << line << ": " << error << "\n";
+            failed++;
+            continue;
+        }
+        jobs.push_back(move(job));
+    }
+
+    if (useCache) {
+        error_code ec;
+        fs::create_directories(cacheDir, ec);
+        if (ec) {
+            cerr << "Cannot create the cache directory " << cacheDir << ": " << ec.message() << "\n";
+            return 1;
+        }
+    }
+
+    // Hits are copied now; a job repeated within the manifest runs once.
+    vector<size_t> toRun;
+    vector<pair<size_t, size_t>> repeats;  // (job, earlier job with the same key)
+    map<string, size_t> firstWithHash;
+    size_t hits = 0;
+    mutex consoleMtx;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const ManifestJob& job = jobs[i];
+        if (useCache && isCached(cacheDir, job)) {
+            if (!copyFile(cachedTrajectory(cacheDir, job), job.outputFilename)) {
+                failed++;
+                continue;
+            }
+            hits++;
+            if (verbose)
+                cout << "line " << job.line << ": cached " << job.hash << " -> " << job.outputFilename << "\n";
+            continue;
+        }
+        auto first = firstWithHash.find(job.hash);
+        if (first != firstWithHash.end()) {
+            repeats.emplace_back(i, first->second);
+            continue;
+        }
+        firstWithHash[job.hash] = i;
+        toRun.push_back(i);
+    }
+
+    vector<char> succeeded(jobs.size(), 0);
+    {
+        ThreadPool pool(threads);
+        for (size_t i : toRun) {
+            pool.submit([&, i]() {
+                ManifestJob& job = jobs[i];
+                TrajectoryHeader header = trajectoryHeaderFor(job.network.events, job.network.species);
+                header.integerCounts = !job.meanField;
+                TrajectoryWriter writer(job.outputFilename, header);
+                bool ok = writer.good();
+                if (ok) {
+                    vector<double> state = job.network.initialState;
+                    job.run(job.network.t_stop, job.network.events, state, writer, job.options);
+                    writer.close();
+                    if (useCache)
+                        storeInCache(cacheDir, job);
+                }
+                succeeded[i] = ok;
+                lock_guard<mutex> lock(consoleMtx);
+                if (!ok)
+                    cerr << "line " << job.line << ": cannot write " << job.outputFilename << "\n";
+                else if (verbose)
+                    cout << "line " << job.line << ": simulated " << job.hash << " -> " << job.outputFilename << endl;
+            });
+        }
+        pool.wait();
+    }
+    for (size_t i : toRun)
+        failed += succeeded[i] ? 0 : 1;
+    for (auto& repeat : repeats) {
+        if (!succeeded[repeat.second] ||
+            !copyFile(jobs[repeat.second].outputFilename, jobs[repeat.first].outputFilename)) {
+            failed++;
+            continue;
+        }
+        if (verbose)
+            cout << "line " << jobs[repeat.first].line << ": same as line " << jobs[repeat.second].line
+                 << " -> " << jobs[repeat.first].outputFilename << "\n";
+    }
+
+    if (verbose)
+        cout << jobs.size() << " jobs: " << toRun.size() << " simulated, " << hits << " from the cache, "
+             << repeats.size() << " repeated" << (failed ? ", " + to_string(failed) + " failed" : "") << "\n";
+    return failed ? 1 : 0;
+}
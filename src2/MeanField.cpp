@@ -0,0 +1,183 @@
+#include "Plasma-Surface-Recombination.h"
+#include "TrajectoryWriter.h"
+#include "Sampling.h"
+#include "OdeSolvers.h"
+#include "Progress.h"
+#include <iostream>
+#include <vector>
+#include <array>
+#include <cmath>
+
+using namespace std;
+
+// dx[species] += factor * x[r1] * x[r2] on the padded state (see ReactionTable).
+struct RateTerm {
+    int species;
+    int r1;
+    int r2;
+    double factor;
+};
+
+// J[row][col] += factor * x[other], from differentiating one RateTerm by x[col].
+struct JacobianTerm {
+    int row;
+    int col;
+    int other;
+    double factor;
+};
+
+// Mass-action rate equations dx/dt = sum_j nu_j * a_j(x) of a reaction
+// network, flattened so that the right-hand side and the Jacobian are single
+// loops over precomputed terms.
+struct MeanFieldSystem {
+    size_t nSpecies = 0;
+    vector<RateTerm> rhs;
+    vector<JacobianTerm> jacobian;
+};
+
+static MeanFieldSystem compileMeanField(const ReactionTable& table)
+{
+    MeanFieldSystem sys;
+    sys.nSpecies = table.nSpecies;
+    const int ghost = static_cast<int>(table.nSpecies);
+    for (size_t j = 0; j < table.nReactions; j++) {
+        const int r1 = table.reactant1[j];
+        const int r2 = table.reactant2[j];
+        for (int e = table.stoichStart[j]; e < table.stoichStart[j + 1]; e++) {
+            const int species = table.stoichSpecies[e];
+            const double factor = static_cast<double>(table.stoichChange[e]) * table.k[j];
+            sys.rhs.push_back({ species, r1, r2, factor });
+            // d(x[r1] x[r2]) = x[r2] dx[r1] + x[r1] dx[r2]; a square reaction
+            // gets both terms, i.e. 2 x dx. The ghost entry is constant.
+            sys.jacobian.push_back({ species, r1, r2, factor });
+            if (r2 != ghost)
+                sys.jacobian.push_back({ species, r2, r1, factor });
+        }
+    }
+    return sys;
+}
+
+// Integrates the rate equations of an N-species network with the stiff
+// Rosenbrock 2(3) solver, handing each accepted step to onStep.
+template <size_t N, typename Observer>
+static OdeStats integrateMeanField(const MeanFieldSystem& sys, double t_stop, array<double, N>& y,
+                                   const OdeTolerances& tol, Observer onStep)
+{
+    auto padded = [](const array<double, N>& y) {
+        array<double, N + 1> x;
+        copy(y.begin(), y.end(), x.begin());
+        x[N] = 1.0;
+        return x;
+    };
+    auto rhs = [&](double, const array<double, N>& y, array<double, N>& dydt) {
+        const array<double, N + 1> x = padded(y);
+        dydt.fill(0.0);
+        for (const RateTerm& term : sys.rhs)
+            dydt[term.species] += term.factor * x[term.r1] * x[term.r2];
+    };
+    auto jac = [&](double, const array<double, N>& y, OdeMatrix<N>& J) {
+        const array<double, N + 1> x = padded(y);
+        for (auto& row : J)
+            row.fill(0.0);
+        for (const JacobianTerm& term : sys.jacobian)
+            J[term.row][term.col] += term.factor * x[term.other];
+    };
+    return integrateRosenbrock23<N>(rhs, jac, 0.0, t_stop, y, tol, onStep);
+}
+
+template <size_t N>
+static OdeStats runMeanField(const MeanFieldSystem& sys, const ReactionTable& table, double t_stop,
+                             vector<double>& state, TrajectorySink& sink, const SimulationOptions& options)
+{
+    const SamplingPolicy& sampling = options.sampling;
+    TrajectorySampler sampler(sampling);
+    const size_t watched = (sampling.species >= 0 && static_cast<size_t>(sampling.species) < N)
+                         ? static_cast<size_t>(sampling.species) : 0;
+
+    // Time, populations and the propensities at that state, as the SSA engines write them.
+    vector<double> x(N + 1, 1.0);
+    vector<double> row(1 + N + table.nReactions);
+    auto record = [&](double time, const array<double, N>& y) {
+        copy(y.begin(), y.end(), x.begin());
+        row[0] = time;
+        copy(y.begin(), y.end(), row.begin() + 1);
+        table.propensities(x.data(), row.data() + 1 + N);
+        sink.writeRow(row.data());
+    };
+
+    array<double, N> y;
+    copy(state.begin(), state.end(), y.begin());
+    record(0.0, y);
+
+    // Grid points come from the dense output; the other modes treat each
+    // step as an event and populations as changed when their integer part does.
+    ProgressReporter progress(t_stop, options);
+    auto onStep = [&](const DenseStep<N>& step) {
+        progress.update(step.t1);
+        if (sampler.fixedGrid()) {
+            double t_grid;
+            while (sampler.gridPointUpTo(step.t1, t_grid))
+                record(t_grid, step.eval(t_grid));
+        }
+        else if (sampler.recordEvent(floor(step.y0[watched]), floor(step.y1[watched]))) {
+            record(step.t1, step.y1);
+        }
+    };
+    OdeStats stats = integrateMeanField<N>(sys, t_stop, y, options.odeTolerances, onStep);
+    progress.finish(t_stop);
+
+    copy(y.begin(), y.end(), state.begin());
+    return stats;
+}
+
+// Function that solves the mean-field (mass-action rate equation) limit of
+// the network and writes it in the same layout as the stochastic engines.
+void simulateMeanField(double t_stop,
+                       const vector<ReactionEvent>& events,
+                       vector<double>& state,
+                       const vector<string>& speciesList,
+                       const string& outputFilename,
+                       const SimulationOptions& options)
+{
+    TrajectoryHeader header = trajectoryHeaderFor(events, speciesList);
+    header.integerCounts = false;
+    TrajectoryWriter writer(outputFilename, header);
+    if (!writer.good())
+        return;
+    simulateMeanField(t_stop, events, state, writer, options);
+    writer.close();
+    if (options.verbose)
+        cout << "Simulation complete. Output written to " << outputFilename << "\n";
+}
+
+void simulateMeanField(double t_stop,
+                       const vector<ReactionEvent>& events,
+                       vector<double>& state,
+                       TrajectorySink& sink,
+                       const SimulationOptions& options)
+{
+    // Continuous populations: the recorded rates are the plain mass-action ones.
+    const ReactionTable table = compileReactionTable(events, state.size(), false);
+    const MeanFieldSystem sys = compileMeanField(table);
+
+    // The solver works on fixed-size states; every species union of the GUI
+    // reactions has between 2 (Basic) and 7 members.
+    OdeStats stats;
+    switch (state.size()) {
+    case 2: stats = runMeanField<2>(sys, table, t_stop, state, sink, options); break;
+    case 3: stats = runMeanField<3>(sys, table, t_stop, state, sink, options); break;
+    case 4: stats = runMeanField<4>(sys, table, t_stop, state, sink, options); break;
+    case 5: stats = runMeanField<5>(sys, table, t_stop, state, sink, options); break;
+    case 6: stats = runMeanField<6>(sys, table, t_stop, state, sink, options); break;
+    case 7: stats = runMeanField<7>(sys, table, t_stop, state, sink, options); break;
+    default:
+        cerr << "Mean-field engine: unsupported number of species (" << state.size() << ")\n";
+        return;
+    }
+
+    if (options.verbose)
+        cout << "Rosenbrock 2(3): " << stats.accepted << " steps, " << stats.rejected
+             << " rejected, " << stats.rhsCalls << " derivative evaluations\n";
+    if (stats.failed)
+        cerr << "Mean-field engine stopped before t_stop (step size too small or too many steps)\n";
+}
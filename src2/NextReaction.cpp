@@ -0,0 +1,219 @@
+#include "Plasma-Surface-Recombination.h"
+#include "TrajectoryWriter.h"
+#include "Random.h"
+#include "Progress.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+// Binary min-heap over reaction indices keyed by their putative firing time.
+// position[j] tracks where reaction j sits so its key can be updated in place.
+class IndexedPriorityQueue {
+public:
+    explicit IndexedPriorityQueue(const vector<double>& keys)
+        : key(keys), heap(keys.size()), position(keys.size())
+    {
+        for (size_t i = 0; i < heap.size(); i++)
+            heap[i] = position[i] = i;
+        for (size_t i = heap.size() / 2; i-- > 0; )
+            siftDown(i);
+    }
+
+    size_t top() const { return heap[0]; }
+    double topKey() const { return key[heap[0]]; }
+
+    void update(size_t j, double newKey)
+    {
+        double old = key[j];
+        key[j] = newKey;
+        if (newKey < old)
+            siftUp(position[j]);
+        else
+            siftDown(position[j]);
+    }
+
+private:
+    void swapNodes(size_t a, size_t b)
+    {
+        swap(heap[a], heap[b]);
+        position[heap[a]] = a;
+        position[heap[b]] = b;
+    }
+
+    void siftUp(size_t i)
+    {
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (key[heap[parent]] <= key[heap[i]])
+                break;
+            swapNodes(i, parent);
+            i = parent;
+        }
+    }
+
+    void siftDown(size_t i)
+    {
+        for (;;) {
+            size_t smallest = i;
+            size_t l = 2 * i + 1, r = l + 1;
+            if (l < heap.size() && key[heap[l]] < key[heap[smallest]])
+                smallest = l;
+            if (r < heap.size() && key[heap[r]] < key[heap[smallest]])
+                smallest = r;
+            if (smallest == i)
+                break;
+            swapNodes(i, smallest);
+            i = smallest;
+        }
+    }
+
+    vector<double> key;
+    vector<size_t> heap;
+    vector<size_t> position;
+};
+
+
+vector<vector<int>> buildDependencyGraph(const ReactionTable& table)
+{
+    // Reactions whose propensity reads each species.
+    vector<vector<int>> readers(table.nSpecies);
+    for (size_t j = 0; j < table.nReactions; j++) {
+        readers[table.reactant1[j]].push_back(static_cast<int>(j));
+        if (table.order[j] >= 2 && table.reactant2[j] != table.reactant1[j])
+            readers[table.reactant2[j]].push_back(static_cast<int>(j));
+    }
+
+    vector<vector<int>> graph(table.nReactions);
+    for (size_t j = 0; j < table.nReactions; j++) {
+        vector<int>& deps = graph[j];
+        deps.push_back(static_cast<int>(j));
+        for (int e = table.stoichStart[j]; e < table.stoichStart[j + 1]; e++)
+            deps.insert(deps.end(), readers[table.stoichSpecies[e]].begin(),
+                        readers[table.stoichSpecies[e]].end());
+        sort(deps.begin(), deps.end());
+        deps.erase(unique(deps.begin(), deps.end()), deps.end());
+    }
+    return graph;
+}
+
+
+// Gibson–Bruck Next Reaction Method: one exponential draw per changed
+// propensity, and only the reactions that depend on the fired one are
+// updated. Output matches simulateMultiReaction.
+void simulateNextReaction(double t_stop,
+                          const vector<ReactionEvent>& events,
+                          vector<double>& state,
+                          const vector<string>& speciesList,
+                          const string& outputFilename,
+                          const SimulationOptions& options)
+{
+    TrajectoryWriter writer(outputFilename, trajectoryHeaderFor(events, speciesList));
+    if (!writer.good())
+        return;
+    simulateNextReaction(t_stop, events, state, writer, options);
+    writer.close();
+    if (options.verbose)
+        cout << "Simulation complete. Output written to " << outputFilename << "\n";
+}
+
+void simulateNextReaction(double t_stop,
+                          const vector<ReactionEvent>& events,
+                          vector<double>& state,
+                          TrajectorySink& sink,
+                          const SimulationOptions& options)
+{
+    const SamplingPolicy& sampling = options.sampling;
+    const size_t nSpecies = state.size();
+    const size_t nEvents = events.size();
+    const ReactionTable table = compileReactionTable(events, nSpecies);
+    const vector<vector<int>> dependents = buildDependencyGraph(table);
+
+    TrajectorySampler sampler(sampling);
+    const size_t watched = (sampling.species >= 0 && static_cast<size_t>(sampling.species) < nSpecies)
+                         ? static_cast<size_t>(sampling.species) : 0;
+
+    // Exact counts and their padded copy (last entry fixed at 1, see ReactionTable).
+    vector<int64_t> n = wholeCounts(state);
+    vector<double> x = paddedState(n);
+
+    double t = 0.0;
+    vector<double> rvec(nEvents, 0.0);
+
+    // Stores the state and the propensities computed at this time step.
+    vector<double> row(1 + nSpecies + nEvents);
+    auto record = [&](double time) {
+        row[0] = time;
+        copy(x.begin(), x.begin() + nSpecies, row.begin() + 1);
+        copy(rvec.begin(), rvec.end(), row.begin() + 1 + nSpecies);
+        sink.writeRow(row.data());
+    };
+
+    // For the initial time step, we have no propensity values.
+    record(t);
+
+    Rng gen = makeGenerator(options);
+    const double never = numeric_limits<double>::infinity();
+
+    auto putativeTime = [&](double a) {
+        return (a > 0.0) ? t + gen.exponential() / a : never;
+    };
+
+    table.propensities(x.data(), rvec.data());
+    vector<double> tau(nEvents);
+    for (size_t j = 0; j < nEvents; j++)
+        tau[j] = putativeTime(rvec[j]);
+    IndexedPriorityQueue queue(tau);
+
+    ProgressReporter progress(t_stop, options);
+
+    while (t < t_stop && nEvents > 0) {
+        const size_t mu = queue.top();
+        const double t_next = queue.topKey();
+
+        // On a fixed output grid the state is piecewise constant between events.
+        double t_grid;
+        while (sampler.gridPointBefore(min(t_next, t_stop), t_grid))
+            record(t_grid);
+
+        if (t_next > t_stop)
+            break;
+        t = t_next;
+
+        const double watchedBefore = x[watched];
+        table.fire(n.data(), x.data(), mu);
+
+        // The row pairs the new state with the propensities that selected the event.
+        if (sampler.recordEvent(watchedBefore, x[watched]))
+            record(t);
+
+        for (int j : dependents[mu]) {
+            const double a_old = rvec[j];
+            const double a_new = table.propensity(x.data(), static_cast<size_t>(j));
+            rvec[j] = a_new;
+            double tau_j;
+            if (static_cast<size_t>(j) == mu || a_old <= 0.0 || tau[j] == never)
+                tau_j = putativeTime(a_new);
+            else if (a_new > 0.0)
+                tau_j = t + (a_old / a_new) * (tau[j] - t);  // reuse the old draw
+            else
+                tau_j = never;
+            tau[j] = tau_j;
+            queue.update(static_cast<size_t>(j), tau_j);
+        }
+
+        progress.update(t);
+    }
+    progress.finish(t);
+
+    // Remaining grid points hold the final state.
+    double t_grid;
+    while (sampler.gridPointUpTo(t_stop, t_grid))
+        record(t_grid);
+
+    copy(x.begin(), x.begin() + nSpecies, state.begin());
+}
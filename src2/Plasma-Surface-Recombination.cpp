@@ -7,6 +7,10 @@
 
 // Necessary libraries/header files
 #include "Plasma-Surface-Recombination.h"
+#include "CommandLine.h"
+#include "RunReport.h"
+#include "Ensemble.h"
+#include "Checkpoint.h"
 #include <iostream>
 #include <vector>
 #include <random>
@@ -16,6 +20,7 @@
 #include <cstdlib>
 #include <functional>
 #include <map>
+#include <memory>
 #include <algorithm>
 #include <set>
 #include <stdio.h>
@@ -23,41 +28,6 @@
 
 using namespace std;
 
-// Global variable for initial concentration of A.
-double initial_A = 0.0;
-
-// Global general parameters (for non‑Basic reactions).
-double global_Tw = 0.0, global_Tg = 0.0, global_M = 0.0;
-bool general_params_extracted = false;
-
-double vD;
-double ED;
-double Er;
-double k_4;
-double vD_sd;
-double ED_sd;
-double Er_ch;
-double k4_ch; 
-
-// This map specifies what type of species each reaction needs
-static const map<string, vector<string>> reactionSpecies = {
-    {"Basic", {"A", "B"}},
-    {"Physisorption", {"A", "Fv", "Af"}},
-    {"Chemisorption", {"A", "Sv", "As", "A2"}},
-    {"Surface Diffusion", {"Af", "Sv", "Fv", "As"}},
-    {"Langmuir-Hinshelwood recombination", {"Af", "As", "Fv", "Sv", "A2"}}
-};
-
-// This map specifies how many parameters each reaction requires
-static const map<string, int> reactionRateCount = {
-    {"Basic", 2},
-    {"Physisorption", 3},
-    {"Chemisorption", 3},
-    {"Surface Diffusion", 2},
-    {"Langmuir-Hinshelwood recombination", 5}
-};
-
-
 #include "Plasma-Surface-Recombination.h"
 #include <iostream>
 #include <vector>
@@ -74,130 +44,149 @@ static const map<string, int> reactionRateCount = {
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
+    vector<string> args;
+    map<string, string> options = extractOptions(argc, argv, args);
+
+    // --serve: long-running simulation server for GUI.py, with the jobs on
+    // stdin or, with --serve=<path>, on a Unix socket (see Server.cpp).
+    if (options.count("serve"))
+        return runServer(options["serve"]);
+
+    // --manifest=<file>: every job of the file in this process, with the
+    // results cached in --cache=<dir> (see Manifest.cpp).
+    if (options.count("manifest"))
+        return runManifest(options["manifest"], options);
+
+    if (args.empty()) {
         cerr << "No arguments provided.\n";
         return 1;
     }
 
-    // Parse reaction names until a numeric token is encountered.
-    vector<string> reactions;
-    int argIndex = 1;
-    while (argIndex < argc) {
-        string token = argv[argIndex];
-        try {
-            stod(token);
-            break;
-        } catch (...) {
-            reactions.push_back(token);
-            argIndex++;
-        }
-    }
-    if (reactions.empty()) {
-        cerr << "No reactions specified.\n";
+    // Reactions, rate parameters, initial populations and t_stop.
+    ReactionNetwork network;
+    string error;
+    if (!parseReactionNetwork(args, network, error)) {
+        cerr << error << "\n";
         return 1;
     }
+    const vector<string>& allSpecies = network.species;
+    const vector<ReactionEvent>& events_MC = network.events;
+    vector<double> initState = network.initialState;
+    const double t_stop = network.t_stop;
 
-    // Compute nominal needed rate constants.
-    int neededRateConstants = 0;
-    for (auto &r : reactions) {
-        auto it = reactionRateCount.find(r);
-        if (it == reactionRateCount.end()) {
-            cerr << "Unknown reaction: " << r << "\n";
-            return 1;
-        }
-        neededRateConstants += it->second;
-    }
-    // Adjust for Langmuir-Hinshelwood recombination if shared.
-    if (find(reactions.begin(), reactions.end(), "Langmuir-Hinshelwood recombination") != reactions.end()) {
-        if ((find(reactions.begin(), reactions.end(), "Chemisorption") != reactions.end()) &&
-            (find(reactions.begin(), reactions.end(), "Surface Diffusion") != reactions.end())) {
-            neededRateConstants = neededRateConstants - reactionRateCount.at("Langmuir-Hinshelwood recombination") + 1;
-        } else if (find(reactions.begin(), reactions.end(), "Chemisorption") != reactions.end()) {
-            neededRateConstants = neededRateConstants - reactionRateCount.at("Langmuir-Hinshelwood recombination") + 3;
-        } else if (find(reactions.begin(), reactions.end(), "Surface Diffusion") != reactions.end()) {
-            neededRateConstants = neededRateConstants - reactionRateCount.at("Langmuir-Hinshelwood recombination") + 3;
-        }
-    }
+    // Run Monte Carlo simulation. --binary writes the indexed binary format.
+    string outputFilename_MC = options.count("binary") ? "output.ptraj" : "output.txt";
+    vector<double> initStatecopy = initState;
 
-    // Build union of species.
-    set<string> usedSpecies;
-    for (auto &r : reactions) {
-        auto it = reactionSpecies.find(r);
-        if (it == reactionSpecies.end()) {
-            cerr << "No species info for reaction: " << r << "\n";
-            return 1;
-        }
-        for (auto &s : it->second)
-            usedSpecies.insert(s);
-    }
-    vector<string> allSpecies;
-    vector<string> fixedOrder = {"A", "B", "Af", "As", "Fv", "Sv", "A2"};
-    for (const auto &s : fixedOrder) {
-        if (usedSpecies.find(s) != usedSpecies.end())
-            allSpecies.push_back(s);
-    }
+    SimulationOptions simOptions;
 
-    int totalNumericNeeded = (reactions.size() == 1 && reactions[0] == "Basic") ? 
-                              (2 + allSpecies.size() + 1) : (3 + neededRateConstants + allSpecies.size() + 1);
-    int numericAvailable = argc - argIndex;
-    if (numericAvailable < totalNumericNeeded) {
-        cerr << "Not enough numeric parameters provided. Expected " << totalNumericNeeded
-             << ", got " << numericAvailable << ".\n";
+    // Console: --quiet (nothing but errors), --progress=bar|machine|off
+    // (machine: "PROGRESS <fraction> <events> <events/s> <ETA s>" lines on
+    // stderr, read by GUI.py).
+    if (!parseConsoleOptions(options, simOptions))
         return 1;
-    }
+    const bool verbose = simOptions.verbose;
 
-    vector<double> rates;
-    rates.reserve(neededRateConstants);
-    if (reactions.size() == 1 && reactions[0] == "Basic") {
-        for (int i = 0; i < 2; i++) {
-            rates.push_back(stod(argv[argIndex++]));
-        }
-    } else {
-        for (int i = 0; i < 3; i++) { // General parameters: Tw, Tg, M.
-            rates.push_back(stod(argv[argIndex++]));
-        
-        }
-        for (int i = 0; i < neededRateConstants; i++) {
-            rates.push_back(stod(argv[argIndex++]));
-        }
-    }
+    // Random stream: --seed=<n>, --replica=<r>; a drawn seed is printed so the
+    // run (or replica r of an ensemble) can be replayed.
+    if (parseStreamOptions(options, simOptions) && verbose)
+        cout << "Random seed: " << simOptions.seed << " (replay with --seed=" << simOptions.seed << ")\n";
 
-
-    vector<double> initState(allSpecies.size(), 0.0);
-    for (int i = 0; i < (int)allSpecies.size(); i++) {
-        initState[i] = stod(argv[argIndex++]);
+    // Output sampling (--sample-dt, --sample-every, --sample-on), --selector,
+    // --tau-eps, --rtol and --atol.
+    if (!parseSimulationOptions(options, network, simOptions, error)) {
+        cerr << error << "\n";
+        return 1;
     }
-
-    double t_stop = stod(argv[argIndex++]);
-
-    // Build mapping from species name to index.
-    map<string,int> speciesMap;
-    for (int i = 0; i < (int)allSpecies.size(); i++) {
-        speciesMap[allSpecies[i]] = i;
+    SamplingPolicy& sampling = simOptions.sampling;
+
+    // Engine: --engine=direct (Gillespie direct method, default), nrm, tau or
+    // ode (deterministic mean-field solution).
+    string engine = options.count("engine") ? options["engine"] : "direct";
+    EngineFunction run = engineByName(engine);
+    if (!run) {
+        cerr << "Unknown engine: " << engine << "\n";
+        return 1;
     }
 
-    if (speciesMap.find("A") != speciesMap.end()) {
-        initial_A = initState[speciesMap["A"]];
-    } else {
-        cerr << "Species A is not in the union; cannot define initial_A.\n";
+    // Checkpoints (direct method): --checkpoint-every=<s> saves the run to
+    // output.checkpoint every s seconds of wall time, --resume continues it.
+    if ((options.count("checkpoint-every") || options.count("resume")) &&
+        (engine != "direct" || options.count("ensemble"))) {
+        cerr << "--checkpoint-every and --resume need a single run of the direct method.\n";
         return 1;
     }
+    if (!parseCheckpointOptions(options, args, outputFilename_MC, simOptions))
+        return 1;
+    const bool checkpointed = !simOptions.checkpointFilename.empty();
+    if (simOptions.resumeFrom && verbose)
+        cout << "Resuming from " << simOptions.checkpointFilename << " (seed " << simOptions.seed << ")\n";
+
+    // Ensemble: --ensemble=<replicas> independent runs on --threads=<n> workers
+    // (default: one per core). Populations and propensities are summarised on
+    // a fixed grid (--sample-dt, default t_stop/1000) in ensemble.txt.
+    if (options.count("ensemble")) {
+        const size_t replicas = stoul(options["ensemble"]);
+        const size_t threads = options.count("threads") ? stoul(options["threads"]) : 0;
+        if (sampling.mode != SamplingPolicy::FixedInterval)
+            sampling = SamplingPolicy::fixedInterval(t_stop / 1000.0);
+        simOptions.verbose = false;
+
+        // Grid shared by every replica: t = 0, then the sampler's grid points.
+        vector<double> gridTimes = { 0.0 };
+        TrajectorySampler probe(sampling);
+        double t_grid;
+        while (probe.gridPointUpTo(t_stop, t_grid))
+            gridTimes.push_back(t_grid);
+
+        TrajectoryHeader header = trajectoryHeaderFor(events_MC, allSpecies);
+        vector<string> valueNames(header.columns.begin() + 1, header.columns.end());
+        EnsembleStatistics grid(gridTimes.size(), valueNames.size());
+        EnsembleStatistics finals(1, allSpecies.size());
+
+        runEnsemble(replicas, threads, grid, finals,
+            [&](size_t replica, TrajectorySink& sink) {
+                SimulationOptions replicaOptions = simOptions;
+                replicaOptions.replica = replica;
+                vector<double> x = initState;
+                run(t_stop, events_MC, x, sink, replicaOptions);
+                return x;
+            });
+
+        grid.writeTable("ensemble.txt", "Time", gridTimes, valueNames);
+        if (verbose) {
+            cout << "Ensemble of " << replicas << " runs complete. Output written to ensemble.txt\n";
+            for (size_t i = 0; i < allSpecies.size(); i++) {
+                const RunningStats& s = finals.stats(0, i);
+                cout << allSpecies[i] << "\t" << s.mean << " +- " << sqrt(s.variance()) << "\n";
+            }
+        }
+        return 0;
+    }
 
-    bool chemPresent = (find(reactions.begin(), reactions.end(), "Chemisorption") != reactions.end());
-    bool surfPresent = (find(reactions.begin(), reactions.end(), "Surface Diffusion") != reactions.end());
-
-    vector<ReactionEvent> events_MC;
-    int ratePos = 0;
-    for (auto &r : reactions) {
-        vector<ReactionEvent> these = buildEventsForReaction(r, rates, ratePos, speciesMap, chemPresent, surfPresent);
-        events_MC.insert(events_MC.end(), these.begin(), these.end());
+    // --report: performance summary of the run in output.report.json (direct method).
+    if (options.count("report")) {
+        if (engine == "direct")
+            simOptions.reportFilename = reportFilenameFor(outputFilename_MC);
+        else
+            cerr << "--report is only collected by the direct method (--engine=direct).\n";
     }
 
-    // Run Monte Carlo simulation.
-    string outputFilename_MC = "output.txt";
-    vector<double> initStatecopy = initState;
-    simulateMultiReaction(t_stop, events_MC, initState, allSpecies, outputFilename_MC);
+    TrajectoryHeader header = trajectoryHeaderFor(events_MC, allSpecies);
+    header.integerCounts = (engine != "ode");
+    // A resumed run continues the file written up to its checkpoint.
+    unique_ptr<TrajectoryWriter> writer(simOptions.resumeFrom
+        ? new TrajectoryWriter(outputFilename_MC, header, *simOptions.resumeFrom)
+        : new TrajectoryWriter(outputFilename_MC, header));
+    if (!writer->good())
+        return 1;
+    run(t_stop, events_MC, initState, *writer, simOptions);
+    writer->close();
+    // The output is complete: its checkpoint is no longer needed.
+    if (checkpointed)
+        remove(simOptions.checkpointFilename.c_str());
+    if (verbose)
+        cout << "Simulation complete. Output written to " << outputFilename_MC << "\n";
 
     return 0;
 }
-
@@ -0,0 +1,311 @@
+/*
+    Simulation server: one engine process serving many runs, so GUI.py does
+    not pay for compilation, process start-up and a file round-trip per run.
+
+    Messages in both directions are frames: a u32 payload length (little
+    endian, like the binary trajectories), then the payload. A request is
+    the engine's command line with one argument per line, e.g.
+    "Basic\n0.1\n0.05\n10000\n5000\n80\n--engine=nrm". Each request is
+    answered with frames whose payload starts with a tag line:
+
+        HEADER\n<column>\t<column>...       columns of the rows that follow
+        PROGRESS\n<fraction> <events> <events/s> <ETA s, -1 if unknown>
+        ROWS\n<f64 values>                  a batch of rows, row after row
+        DONE\n<rows> <wall seconds> <seed>
+        ERROR\n<message>                    the request failed; the server goes on
+
+    --output=<file> in a request also writes the trajectory to that file and
+    --quiet turns the progress frames off. Parsed networks are kept, keyed by
+    their positional arguments, so repeating a run reuses them; past 16 the
+    least recently used one is dropped. A "QUIT" request or the end of the
+    input stops the server. Console output of the engines goes to stderr,
+    leaving stdout to the frames.
+*/
+
+#include "Plasma-Surface-Recombination.h"
+#include "CommandLine.h"
+#include "RunReport.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define PSR_UNIX_SOCKETS 1
+#endif
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Length-prefixed frames over a pair of streams.
+class FrameChannel {
+public:
+    FrameChannel(FILE* in, FILE* out) : in(in), out(out) {}
+
+    // Reads the next frame; false at the end of the input or on a bad length.
+    bool read(string& payload)
+    {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, in) != 1 || length > maxRequest)
+            return false;
+        payload.resize(length);
+        return length == 0 || fread(&payload[0], 1, length, in) == length;
+    }
+
+    void write(const char* tag, const void* body, size_t size)
+    {
+        const size_t tagLength = strlen(tag);
+        const uint32_t length = static_cast<uint32_t>(tagLength + 1 + size);
+        fwrite(&length, sizeof(length), 1, out);
+        fwrite(tag, 1, tagLength, out);
+        fputc('\n', out);
+        if (size > 0)
+            fwrite(body, 1, size, out);
+        fflush(out);
+    }
+
+    void write(const char* tag, const string& body) { write(tag, body.data(), body.size()); }
+
+private:
+    static const uint32_t maxRequest = 1u << 20;
+    FILE* in;
+    FILE* out;
+};
+
+// Sends the rows of a run in ROWS frames, optionally copying them to a file.
+class FrameSink : public TrajectorySink {
+public:
+    FrameSink(FrameChannel& channel, size_t nColumns, TrajectorySink* copy)
+        : channel(channel), nColumns(nColumns), copy(copy)
+    {
+        buffer.reserve(rowsPerFrame * nColumns);
+    }
+
+    void writeRow(const double* values) override
+    {
+        buffer.insert(buffer.end(), values, values + nColumns);
+        rows++;
+        if (copy)
+            copy->writeRow(values);
+        if (buffer.size() >= rowsPerFrame * nColumns)
+            flush();
+    }
+
+    void flush()
+    {
+        if (!buffer.empty())
+            channel.write("ROWS", buffer.data(), buffer.size() * sizeof(double));
+        buffer.clear();
+    }
+
+    long long rows = 0;
+
+private:
+    static const size_t rowsPerFrame = 4096;
+    FrameChannel& channel;
+    size_t nColumns;
+    TrajectorySink* copy;
+    vector<double> buffer;
+};
+
+// Networks kept between requests. Each entry records the request that last
+// used it, and the least recently used entry is evicted when the cache is full.
+const size_t maxNetworks = 16;
+struct CachedNetwork {
+    ReactionNetwork network;
+    unsigned long long lastUse = 0;
+};
+struct NetworkCache {
+    map<vector<string>, CachedNetwork> entries;
+    unsigned long long requests = 0;
+};
+
+void runJob(FrameChannel& channel, const vector<string>& tokens, NetworkCache& networks)
+{
+    const auto start = chrono::steady_clock::now();
+    vector<string> args;
+    map<string, string> options = extractOptions(tokens, args);
+    string error;
+
+    auto cached = networks.entries.find(args);
+    if (cached == networks.entries.end()) {
+        CachedNetwork entry;
+        if (!parseReactionNetwork(args, entry.network, error)) {
+            channel.write("ERROR", error);
+            return;
+        }
+        if (networks.entries.size() >= maxNetworks)
+            networks.entries.erase(min_element(networks.entries.begin(), networks.entries.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; }));
+        cached = networks.entries.emplace(args, move(entry)).first;
+    }
+    cached->second.lastUse = ++networks.requests;
+    const ReactionNetwork& network = cached->second.network;
+
+    SimulationOptions simOptions;
+    simOptions.progress = ProgressStyle::Callback;
+    simOptions.progressCallback = [&](double fraction, long long events, double rate, double eta) {
+        ostringstream body;
+        body << fraction << " " << events << " " << rate << " " << eta;
+        channel.write("PROGRESS", body.str());
+    };
+    if (options.count("quiet")) {
+        simOptions.verbose = false;
+        simOptions.progress = ProgressStyle::Off;
+    }
+    parseStreamOptions(options, simOptions);
+    if (!parseSimulationOptions(options, network, simOptions, error)) {
+        channel.write("ERROR", error);
+        return;
+    }
+    const string engine = options.count("engine") ? options["engine"] : "direct";
+    EngineFunction run = engineByName(engine);
+    if (!run) {
+        channel.write("ERROR", "Unknown engine: " + engine);
+        return;
+    }
+    if (options.count("ensemble")) {
+        channel.write("ERROR", "--ensemble is not served; run the engine from the command line.");
+        return;
+    }
+
+    TrajectoryHeader header = trajectoryHeaderFor(network.events, network.species);
+    header.integerCounts = (engine != "ode");
+    string columns;
+    for (size_t i = 0; i < header.columns.size(); i++)
+        columns += (i ? "\t" : "") + header.columns[i];
+
+    const string outputFilename = options.count("output") ? options["output"] : "";
+    unique_ptr<TrajectoryWriter> writer;
+    if (!outputFilename.empty()) {
+        writer.reset(new TrajectoryWriter(outputFilename, header));
+        if (!writer->good()) {
+            channel.write("ERROR", "Cannot write " + outputFilename);
+            return;
+        }
+    }
+    if (options.count("report") && engine == "direct")
+        simOptions.reportFilename = reportFilenameFor(outputFilename.empty() ? "output.txt" : outputFilename);
+
+    channel.write("HEADER", columns);
+    FrameSink sink(channel, header.columns.size(), writer.get());
+    try {
+        vector<double> state = network.initialState;
+        run(network.t_stop, network.events, state, sink, simOptions);
+    } catch (const exception& e) {
+        channel.write("ERROR", e.what());
+        return;
+    }
+    sink.flush();
+    if (writer)
+        writer->close();
+
+    ostringstream done;
+    done << sink.rows << " " << chrono::duration<double>(chrono::steady_clock::now() - start).count()
+         << " " << simOptions.seed;
+    channel.write("DONE", done.str());
+}
+
+// Serves requests until the end of the input or QUIT; returns true on QUIT.
+bool serve(FrameChannel& channel, NetworkCache& networks)
+{
+    string request;
+    while (channel.read(request)) {
+        vector<string> tokens;
+        istringstream lines(request);
+        string line;
+        while (getline(lines, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                tokens.push_back(line);
+        }
+        if (tokens.size() == 1 && tokens[0] == "QUIT")
+            return true;
+        runJob(channel, tokens, networks);
+    }
+    return false;
+}
+
+}
+
+int runServer(const string& socketPath)
+{
+    // The engines' console output must not mix with the frames on stdout.
+    cout.rdbuf(cerr.rdbuf());
+    NetworkCache networks;
+
+    if (socketPath.empty()) {
+#if defined(_WIN32)
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        FrameChannel channel(stdin, stdout);
+        serve(channel, networks);
+        return 0;
+    }
+
+#if defined(PSR_UNIX_SOCKETS)
+    // A client that goes away mid-run must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << socketPath << "\n";
+        return 1;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 4) != 0) {
+        cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    // One client at a time; QUIT from any of them stops the server.
+    bool quit = false;
+    while (!quit) {
+        const int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+            continue;
+        FILE* in = fdopen(connection, "rb");
+        FILE* out = fdopen(dup(connection), "wb");
+        if (in && out) {
+            FrameChannel channel(in, out);
+            quit = serve(channel, networks);
+        }
+        if (in)
+            fclose(in);
+        if (out)
+            fclose(out);
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+    return 0;
+#else
+    cerr << "Unix sockets are not available on this platform; use --serve without a path.\n";
+    return 1;
+#endif
+}
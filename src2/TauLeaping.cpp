@@ -0,0 +1,269 @@
+#include "Plasma-Surface-Recombination.h"
+#include "TrajectoryWriter.h"
+#include "Random.h"
+#include "Progress.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+// Reactions that could exhaust a reactant within this many firings are
+// "critical" and are only ever fired one at a time.
+static const double criticalFirings = 10.0;
+// If the leap is shorter than this many mean SSA steps, take exact steps instead.
+static const double leapToSsaRatio = 10.0;
+static const int ssaStepsPerFallback = 100;
+
+// Molecules of each reactant consumed by one firing, from the compiled table.
+struct ReactantUse {
+    int species;
+    double count;
+};
+
+// Adaptive explicit tau-leaping (Cao, Gillespie & Petzold 2006). Each leap is
+// bounded so that the expected relative change of every reactant population
+// stays below options.tauEpsilon. Reactions close to exhausting a reactant are
+// handled exactly, and the engine falls back to plain SSA steps whenever a
+// leap would cover only a few events. Output matches simulateMultiReaction,
+// with one row per leap.
+void simulateTauLeaping(double t_stop,
+                        const vector<ReactionEvent>& events,
+                        vector<double>& state,
+                        const vector<string>& speciesList,
+                        const string& outputFilename,
+                        const SimulationOptions& options)
+{
+    TrajectoryWriter writer(outputFilename, trajectoryHeaderFor(events, speciesList));
+    if (!writer.good())
+        return;
+    simulateTauLeaping(t_stop, events, state, writer, options);
+    writer.close();
+    if (options.verbose)
+        cout << "Simulation complete. Output written to " << outputFilename << "\n";
+}
+
+void simulateTauLeaping(double t_stop,
+                        const vector<ReactionEvent>& events,
+                        vector<double>& state,
+                        TrajectorySink& sink,
+                        const SimulationOptions& options)
+{
+    const SamplingPolicy& sampling = options.sampling;
+    const double eps = options.tauEpsilon;
+    const size_t nSpecies = state.size();
+    const size_t nEvents = events.size();
+    const ReactionTable table = compileReactionTable(events, nSpecies);
+
+    // Reactant consumption per reaction and the Cao g_i factor inputs: the
+    // highest order of any reaction each species is a reactant of, and whether
+    // that reaction needs two molecules of it.
+    vector<vector<ReactantUse>> reactants(nEvents);
+    vector<int> highestOrder(nSpecies, 0);
+    vector<bool> needsTwo(nSpecies, false);
+    for (size_t j = 0; j < nEvents; j++) {
+        for (int e = table.stoichStart[j]; e < table.stoichStart[j + 1]; e++) {
+            if (table.stoichChange[e] < 0)
+                reactants[j].push_back({ table.stoichSpecies[e], static_cast<double>(-table.stoichChange[e]) });
+        }
+        int r1 = table.reactant1[j];
+        int order = table.order[j];
+        highestOrder[r1] = max(highestOrder[r1], order);
+        if (order >= 2) {
+            int r2 = table.reactant2[j];
+            highestOrder[r2] = max(highestOrder[r2], order);
+            if (r2 == r1)
+                needsTwo[r1] = true;
+        }
+    }
+
+    TrajectorySampler sampler(sampling);
+    const size_t watched = (sampling.species >= 0 && static_cast<size_t>(sampling.species) < nSpecies)
+                         ? static_cast<size_t>(sampling.species) : 0;
+
+    // Exact counts and their padded copy (last entry fixed at 1, see ReactionTable).
+    vector<int64_t> n = wholeCounts(state);
+    vector<double> x = paddedState(n);
+    vector<int64_t> trial(n);
+
+    double t = 0.0;
+    vector<double> rvec(nEvents, 0.0);
+
+    // Stores the state and the propensities computed at this time step.
+    vector<double> row(1 + nSpecies + nEvents);
+    auto record = [&](double time) {
+        row[0] = time;
+        copy(x.begin(), x.begin() + nSpecies, row.begin() + 1);
+        copy(rvec.begin(), rvec.end(), row.begin() + 1 + nSpecies);
+        sink.writeRow(row.data());
+    };
+
+    // For the initial time step, we have no propensity values.
+    record(t);
+
+    Rng gen = makeGenerator(options);
+    const double never = numeric_limits<double>::infinity();
+
+    auto pickReaction = [&](double total, const vector<bool>* onlyCritical) {
+        double r = gen.uniform() * total;
+        double cum = 0.0;
+        size_t last = nEvents;
+        for (size_t j = 0; j < nEvents; j++) {
+            if (onlyCritical && !(*onlyCritical)[j])
+                continue;
+            if (rvec[j] <= 0.0)
+                continue;
+            cum += rvec[j];
+            last = j;
+            if (cum >= r)
+                return j;
+        }
+        return last;
+    };
+
+    // Advances the clock to t_new, writing any grid points passed on the way.
+    auto advance = [&](double t_new) {
+        double t_grid;
+        while (sampler.gridPointBefore(min(t_new, t_stop), t_grid))
+            record(t_grid);
+        t = t_new;
+    };
+
+    vector<bool> critical(nEvents, false);
+    vector<double> mu(nSpecies), sigma2(nSpecies);
+
+    ProgressReporter progress(t_stop, options);
+
+    while (t < t_stop) {
+        double a0 = table.propensities(x.data(), rvec.data());
+        if (a0 <= 1e-15)
+            break;
+
+        // Critical reactions: fewer than criticalFirings firings left before a
+        // reactant runs out.
+        double aCritical = 0.0;
+        for (size_t j = 0; j < nEvents; j++) {
+            double firingsLeft = never;
+            for (auto &use : reactants[j])
+                firingsLeft = min(firingsLeft, floor(x[use.species] / use.count));
+            critical[j] = rvec[j] > 0.0 && firingsLeft < criticalFirings;
+            if (critical[j])
+                aCritical += rvec[j];
+        }
+
+        // Cao step selection over the non-critical reactions.
+        fill(mu.begin(), mu.end(), 0.0);
+        fill(sigma2.begin(), sigma2.end(), 0.0);
+        for (size_t j = 0; j < nEvents; j++) {
+            if (critical[j] || rvec[j] <= 0.0)
+                continue;
+            for (int e = table.stoichStart[j]; e < table.stoichStart[j + 1]; e++) {
+                double v = static_cast<double>(table.stoichChange[e]);
+                mu[table.stoichSpecies[e]] += v * rvec[j];
+                sigma2[table.stoichSpecies[e]] += v * v * rvec[j];
+            }
+        }
+        double tauNonCritical = never;
+        for (size_t i = 0; i < nSpecies; i++) {
+            if (highestOrder[i] == 0)
+                continue;
+            double g = highestOrder[i];
+            if (needsTwo[i] && x[i] > 1.0)
+                g += 1.0 / (x[i] - 1.0);
+            double bound = max(eps * x[i] / g, 1.0);
+            if (mu[i] != 0.0)
+                tauNonCritical = min(tauNonCritical, bound / fabs(mu[i]));
+            if (sigma2[i] > 0.0)
+                tauNonCritical = min(tauNonCritical, bound * bound / sigma2[i]);
+        }
+
+        // Leaps this short gain nothing over exact simulation.
+        if (tauNonCritical < leapToSsaRatio / a0) {
+            long long fired = 0;
+            for (int step = 0; step < ssaStepsPerFallback && t < t_stop; step++) {
+                if (step > 0)
+                    a0 = table.propensities(x.data(), rvec.data());
+                if (a0 <= 1e-15)
+                    break;
+                double t_new = t + gen.exponential() / a0;
+                if (t_new > t_stop) {
+                    advance(t_stop);
+                    break;
+                }
+                advance(t_new);
+                size_t chosen = pickReaction(a0, nullptr);
+                if (chosen >= nEvents)
+                    break;
+                const double watchedBefore = x[watched];
+                table.fire(n.data(), x.data(), chosen);
+                fired++;
+                if (sampler.recordEvent(watchedBefore, x[watched]))
+                    record(t);
+            }
+            progress.update(t, fired);
+            continue;
+        }
+
+        // Leap; halve the non-critical step whenever a population would go negative.
+        bool accepted = false;
+        long long fired = 0;
+        while (!accepted) {
+            double tauCritical = (aCritical > 0.0) ? gen.exponential() / aCritical : never;
+            double tau = min(tauNonCritical, tauCritical);
+            bool fireCritical = tauCritical <= tauNonCritical;
+            if (t + tau > t_stop) {
+                tau = t_stop - t;
+                fireCritical = false;
+            }
+
+            copy(n.begin(), n.end(), trial.begin());
+            fired = 0;
+            for (size_t j = 0; j < nEvents; j++) {
+                if (critical[j] || rvec[j] <= 0.0)
+                    continue;
+                poisson_distribution<long long> firings(rvec[j] * tau);
+                const long long drawn = firings(gen);
+                if (drawn == 0)
+                    continue;
+                fired += drawn;
+                for (int e = table.stoichStart[j]; e < table.stoichStart[j + 1]; e++)
+                    trial[table.stoichSpecies[e]] += drawn * table.stoichChange[e];
+            }
+            if (fireCritical) {
+                size_t chosen = pickReaction(aCritical, &critical);
+                if (chosen < nEvents) {
+                    fired++;
+                    for (int e = table.stoichStart[chosen]; e < table.stoichStart[chosen + 1]; e++)
+                        trial[table.stoichSpecies[e]] += table.stoichChange[e];
+                }
+            }
+
+            accepted = all_of(trial.begin(), trial.end(), [](int64_t v) { return v >= 0; });
+            if (!accepted) {
+                tauNonCritical /= 2.0;
+                continue;
+            }
+
+            const double watchedBefore = x[watched];
+            advance(t + tau);
+            n.swap(trial);
+            for (size_t i = 0; i < nSpecies; i++)
+                x[i] = static_cast<double>(n[i]);
+            if (sampler.recordEvent(watchedBefore, x[watched]))
+                record(t);
+        }
+
+        progress.update(t, fired);
+    }
+    progress.finish(t);
+
+    // Remaining grid points hold the final state.
+    double t_grid;
+    while (sampler.gridPointUpTo(t_stop, t_grid))
+        record(t_grid);
+
+    copy(x.begin(), x.begin() + nSpecies, state.begin());
+}